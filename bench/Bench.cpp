@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "Decode.hpp"
+#include "Instr.hpp"
+#include "Loader.hpp"
+#include "Machine.hpp"
+#include "Workloads.hpp"
+
+namespace fs = std::filesystem;
+
+namespace{
+    // Output sink that takes everything and keeps nothing, so disk speed stays out of the numbers
+    class NullBuffer : public std::streambuf{
+    protected:
+        int overflow(int c) override{ return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize n) override{ return n; }
+    };
+
+    // Keeps only an FNV-1a hash of the output, to compare two conversions without storing either
+    class DigestBuffer : public std::streambuf{
+    public:
+        uint64_t digest = 14695981039346656037ull;
+
+    protected:
+        int overflow(int c) override{
+            if(c != traits_type::eof()) add(static_cast<char>(c));
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override{
+            for(std::streamsize i = 0; i < n; i++) add(s[i]);
+            return n;
+        }
+
+    private:
+        void add(char c){ digest = (digest ^ static_cast<uint8_t>(c)) * 1099511628211ull; }
+    };
+
+    struct Sample{
+        double parse; // loadSource + decodeProgram
+        double run; // execution and emission
+        uint64_t executed;
+        uint64_t bytes;
+    };
+
+    // One conversion of source, the same steps as the command line tool
+    Sample convert(Machine& m, const std::string& source, std::streambuf& buffer){
+        using Clock = std::chrono::steady_clock;
+        std::ostream sink(&buffer);
+
+        m.reset();
+        m.out.open(&sink);
+        Clock::time_point start, decoded, end;
+        try{
+            start = Clock::now();
+            loadSource(m, source);
+            m.out << m.currentLabel << ":\n";
+            decodeProgram(m);
+            decoded = Clock::now();
+            Instr::run(m, m.entry);
+            m.finishTrace();
+            m.out.close();
+            end = Clock::now();
+        }catch(...){
+            m.out.close(); // before sink goes away
+            throw;
+        }
+
+        return {
+            .parse = std::chrono::duration<double>(decoded - start).count(),
+            .run = std::chrono::duration<double>(end - decoded).count(),
+            .executed = m.executed,
+            .bytes = m.out.bytes()
+        };
+    }
+
+    double median(std::vector<double> values){
+        std::sort(values.begin(), values.end());
+        size_t n = values.size();
+        return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    }
+
+    void usage(){
+        std::cerr << "usage: MovFuscatorBench [--scale N] [--repeat N] [--threads N] [--write DIR] [--reroll] [--dead-stores] [--summarize-loops] [--jit] [workload...]\n"
+                     "workloads:\n";
+        for(const Workloads::Workload& w : Workloads::all())
+            std::cerr << "  " << std::left << std::setw(15) << w.name << w.description << '\n';
+    }
+}
+
+// Converts every workload --repeat times after one warm-up run and prints the
+// median rates: instructions executed per second of run, source lines parsed
+// (and decoded) per second, output MB per second of the whole conversion.
+// With --jit the warm-up run is also checked against one without it: a workload
+// whose output differs is reported and the exit status is 1.
+int main(int argc, char* argv[]){
+    uint32_t scale = 1;
+    uint32_t repeat = 5;
+    uint32_t threads = 1;
+    std::string writeDir;
+    bool reroll = false, deadStores = false, summarizeLoops = false, jit = false;
+    std::vector<std::string> selected;
+
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try{
+            if(arg == "--scale" && hasValue) scale = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if(arg == "--repeat" && hasValue) repeat = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if(arg == "--threads" && hasValue) threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if(arg == "--write" && hasValue) writeDir = argv[++i];
+            else if(arg == "--reroll") reroll = true;
+            else if(arg == "--dead-stores") deadStores = true;
+            else if(arg == "--summarize-loops") summarizeLoops = true;
+            else if(arg == "--jit") jit = true;
+            else if(arg.rfind("--", 0) == 0){
+                usage();
+                return 1;
+            }else selected.push_back(arg);
+        }catch(const std::exception&){
+            std::cerr << "Bad " << arg << ' ' << argv[i] << '\n';
+            return 1;
+        }
+    }
+    if(scale == 0 || repeat == 0 || threads == 0){
+        usage();
+        return 1;
+    }
+    for(const std::string& name : selected){
+        const auto& all = Workloads::all();
+        if(std::none_of(all.begin(), all.end(), [&](const auto& w){ return name == w.name; })){
+            std::cerr << "Unknown workload " << name << '\n';
+            usage();
+            return 1;
+        }
+    }
+
+#ifndef __OPTIMIZE__
+    std::cerr << "warning: unoptimized build, configure with -DCMAKE_BUILD_TYPE=Release\n";
+#endif
+    std::cout << "scale " << scale << ", median of " << repeat << " runs\n";
+    std::cout << std::left << std::setw(15) << "workload" << std::right
+              << std::setw(10) << "lines" << std::setw(13) << "instructions" << std::setw(11) << "output MB"
+              << std::setw(13) << "lines/s" << std::setw(13) << "instr/s" << std::setw(10) << "MB/s" << '\n';
+
+    // Sparse pages: only what the workloads touch is allocated
+    bool differs = false;
+    Machine machine(256 << 20);
+    machine.reroll.enabled = reroll;
+    machine.deadStores.enabled = deadStores;
+    machine.loops.enabled = summarizeLoops;
+    machine.jit.enabled = jit && Jit::supported();
+    machine.threads = threads;
+
+    for(const Workloads::Workload& workload : Workloads::all()){
+        if(!selected.empty() && std::find(selected.begin(), selected.end(), workload.name) == selected.end())
+            continue;
+        std::string source = workload.generate(scale);
+        uint64_t lines = std::count(source.begin(), source.end(), '\n');
+        if(!writeDir.empty()){
+            fs::create_directories(writeDir);
+            std::ofstream(fs::path(writeDir) / (std::string(workload.name) + ".s")) << source;
+        }
+
+        std::vector<double> lineRates, instrRates, byteRates;
+        Sample sample{};
+        try{
+            if(machine.jit.enabled){
+                DigestBuffer plain, native;
+                machine.jit.enabled = false;
+                convert(machine, source, plain);
+                machine.jit.enabled = true;
+                convert(machine, source, native);
+                if(plain.digest != native.digest){
+                    std::cout << std::left << std::setw(15) << workload.name << "output differs with --jit" << std::endl;
+                    differs = true;
+                    continue;
+                }
+            }else{
+                NullBuffer warmUp;
+                convert(machine, source, warmUp);
+            }
+            for(uint32_t i = 0; i < repeat; i++){
+                NullBuffer buffer;
+                sample = convert(machine, source, buffer);
+                lineRates.push_back(lines / sample.parse);
+                instrRates.push_back(sample.executed / sample.run);
+                byteRates.push_back(sample.bytes / (sample.parse + sample.run) / 1e6);
+            }
+        }catch(const std::exception& e){
+            std::cout << std::left << std::setw(15) << workload.name << e.what() << std::endl;
+            continue;
+        }
+
+        std::cout << std::left << std::setw(15) << workload.name << std::right
+                  << std::setw(10) << lines << std::setw(13) << sample.executed
+                  << std::fixed << std::setprecision(1) << std::setw(11) << sample.bytes / 1e6
+                  << std::setprecision(0) << std::setw(13) << median(lineRates) << std::setw(13) << median(instrRates)
+                  << std::setprecision(1) << std::setw(10) << median(byteRates) << std::endl
+                  << std::defaultfloat;
+    }
+    return differs ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+#include "Workloads.hpp"
+
+#include <sstream>
+
+namespace Workloads{
+    static const char* EXIT =
+        "movl $1, %eax\n"
+        "xorl %ebx, %ebx\n"
+        "int $0x80\n";
+
+    std::string nestedLoops(uint32_t scale){
+        std::ostringstream s;
+        s << ".data\n"
+             "acc: .long 0\n"
+             ".text\n"
+             ".global main\n"
+             "main:\n"
+             "xorl %esi, %esi\n"
+             "outer:\n"
+             "movl $1000, %ecx\n"
+             "inner:\n"
+             "addl %ecx, %eax\n"
+             "xorl %eax, %edx\n"
+             "loop inner\n"
+             "incl %esi\n"
+             "cmp $" << 1000 * scale << ", %esi\n"
+             "jl outer\n"
+             "movl %eax, acc\n"
+          << EXIT;
+        return s.str();
+    }
+
+    std::string arrayScan(uint32_t scale){
+        const uint32_t length = 65536;
+        std::ostringstream s;
+        s << ".data\n"
+             "v: .space " << 4 * length << "\n"
+             "sum: .long 0\n"
+             ".text\n"
+             ".global main\n"
+             "main:\n"
+             "lea v, %edi\n"
+             "movl $" << length << ", %ecx\n"
+             "fill:\n"
+             "decl %ecx\n"
+             "movl %ecx, (%edi, %ecx, 4)\n"
+             "cmp $0, %ecx\n"
+             "jne fill\n"
+             "movl $" << 16 * scale << ", %esi\n"
+             "pass:\n"
+             "xorl %eax, %eax\n"
+             "movl $" << length << ", %ecx\n"
+             "scan:\n"
+             "decl %ecx\n"
+             "addl (%edi, %ecx, 4), %eax\n"
+             "cmp $0, %ecx\n"
+             "jne scan\n"
+             "decl %esi\n"
+             "cmp $0, %esi\n"
+             "jne pass\n"
+             "movl %eax, sum\n"
+          << EXIT;
+        return s.str();
+    }
+
+    std::string recursion(uint32_t scale){
+        std::ostringstream s;
+        // fib comes first: the program runs from main to the end of the file
+        s << ".data\n"
+             "result: .long 0\n"
+             ".text\n"
+             "fib:\n"
+             "cmp $2, %eax\n"
+             "jl fib_done\n"
+             "pushl %eax\n"
+             "decl %eax\n"
+             "call fib\n"
+             "popl %ebx\n"
+             "pushl %eax\n"
+             "movl %ebx, %eax\n"
+             "subl $2, %eax\n"
+             "call fib\n"
+             "popl %ebx\n"
+             "addl %ebx, %eax\n"
+             "fib_done:\n"
+             "ret\n"
+             ".global main\n"
+             "main:\n"
+             "movl $" << 16 * scale << ", %esi\n"
+             "again:\n"
+             "movl $20, %eax\n"
+             "call fib\n"
+             "decl %esi\n"
+             "cmp $0, %esi\n"
+             "jne again\n"
+             "movl %eax, result\n"
+          << EXIT;
+        return s.str();
+    }
+
+    std::string dataTables(uint32_t scale){
+        std::ostringstream s;
+        s << ".data\n";
+        for(uint32_t i = 0; i < 100000 * scale; i++){
+            if(i % 16 == 15) s << "msg" << i << ": .asciz \"row " << i << "\"\n";
+            else s << "t" << i << ": .long " << i << ", " << i * 7 << ", 0x" << std::hex << i << std::dec << ", -" << i << '\n';
+        }
+        s << ".text\n"
+             ".global main\n"
+             "main:\n"
+             "movl t0, %eax\n"
+             "addl t1, %eax\n"
+          << EXIT;
+        return s.str();
+    }
+
+    std::string straightLine(uint32_t scale){
+        static const char* lines[] = {
+            "addl %eax, %ebx\n",
+            "xorl %ecx, %edx\n",
+            "movl %ebx, x\n",
+            "incl %ecx\n",
+            "shll $1, %edx\n",
+            "subl $3, %ebx\n",
+            "movl x, %esi\n",
+        };
+        std::ostringstream s;
+        s << ".data\n"
+             "x: .long 0\n"
+             ".text\n"
+             ".global main\n"
+             "main:\n";
+        for(uint32_t i = 0; i < 1000000 * scale; i++){
+            if(i % 8 == 0) s << "movl $" << i << ", %eax\n";
+            else s << lines[i % 8 - 1];
+        }
+        s << EXIT;
+        return s.str();
+    }
+
+    std::string carryAfterStep(uint32_t scale){
+        std::ostringstream s;
+        s << ".data\n"
+             "x: .long 0\n"
+             ".text\n"
+             ".global main\n"
+             "main:\n"
+             "movl $" << 1000 * scale << ", %esi\n"
+             "pass:\n"
+             "xorl %ebx, %ebx\n"
+             "step:\n"
+             "incl %ebx\n"
+             "cmp $100, %ebx\n"
+             "movl x, %eax\n"
+             "incl %ecx\n"
+             "jb step\n"
+             "decl %esi\n"
+             "cmp $0, %esi\n"
+             "jne pass\n"
+             "movl %ecx, x\n"
+          << EXIT;
+        return s.str();
+    }
+
+    const std::vector<Workload>& all(){
+        static const std::vector<Workload> workloads = {
+            {"nested_loops", "nested counted loops", nestedLoops},
+            {"array_scan", "(%edi, %ecx, 4) over a .space table", arrayScan},
+            {"recursion", "recursive fib(20), call/ret", recursion},
+            {"data_tables", "large .data tables", dataTables},
+            {"straight_line", "straight-line code", straightLine},
+            {"carry_step", "jb after incl past a load", carryAfterStep},
+        };
+        return workloads;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Synthetic programs for the benchmark. Each one stresses a different part of
+// the converter and grows linearly with scale.
+namespace Workloads{
+    struct Workload{
+        const char* name;
+        const char* description;
+        std::string (*generate)(uint32_t scale);
+    };
+
+    // Nested counted loops, arithmetic on registers: dispatch and emission
+    std::string nestedLoops(uint32_t scale);
+    // Filling and summing a .space table through (%edi, %ecx, 4)
+    std::string arrayScan(uint32_t scale);
+    // Recursive fibonacci with call/ret/push/pop
+    std::string recursion(uint32_t scale);
+    // Many .long tables, almost no code: .data parsing
+    std::string dataTables(uint32_t scale);
+    // A million lines of straight-line code per scale step: .text parsing and decoding
+    std::string straightLine(uint32_t scale);
+    // jb after incl with a load in between: the CF the jump reads comes from the cmp before both
+    std::string carryAfterStep(uint32_t scale);
+
+    const std::vector<Workload>& all();
+}
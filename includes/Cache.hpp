@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "MovFuscator.hpp"
+
+// --cache: results of earlier conversions on disk, keyed by a hash of the
+// source, the options that change the output and the converter's own build,
+// so an unchanged input is answered without parsing or running it.
+// Entries are written to a temporary file and renamed into place, so several
+// processes can share a directory and a reader never sees half an entry.
+// When the directory grows past its size the least recently used entries go.
+namespace Cache{
+    constexpr uint64_t DEFAULT_SIZE = uint64_t(256) << 20;
+
+    // 128 bits: two XXH64 of the same input with different seeds
+    struct Key{
+        uint64_t high, low;
+        std::string hex() const;
+    };
+
+    uint64_t xxh64(std::string_view data, uint64_t seed);
+
+    // What the command line tool shows for a conversion
+    struct Entry{
+        std::string output;
+        std::string diagnostics;
+        std::string error;
+        uint64_t executed = 0;
+    };
+
+    class Store{
+    public:
+        Store(std::string dir, uint64_t maxBytes = DEFAULT_SIZE);
+
+        // Key of a conversion of source with options (jit and threads don't change the output)
+        static Key key(std::string_view source, const MovFuscator::Options& options);
+        // Whether a result may be kept: one stopped by the clock could end elsewhere next time
+        static bool cacheable(const MovFuscator::Result& result, const MovFuscator::Options& options);
+
+        bool lookup(const Key& key, Entry& entry) const;
+        void store(const Key& key, const Entry& entry);
+
+        // Largest output worth keeping, bigger ones would push out many entries
+        uint64_t maxEntry() const{ return maxBytes / 8; }
+
+    private:
+        std::string dir;
+        uint64_t maxBytes;
+        std::atomic<uint64_t> sinceTrim{UINT64_MAX}; // bytes stored since the last trim, first store trims
+        void trim();
+    };
+}
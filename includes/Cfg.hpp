@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Machine;
+
+// Static control-flow graph of the decoded program. A basic block starts at a
+// label, at the entry point and after every jmp, jcc, loop, call or ret, and
+// runs up to the next such boundary.
+namespace Cfg{
+    constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Block{
+        uint32_t begin, end; // instructions [begin, end)
+        std::vector<uint32_t> succs; // taken jump first, then the fall-through
+        std::vector<uint32_t> preds;
+        uint32_t fallthrough = NONE; // successor reached without jumping
+        uint32_t idom = NONE; // immediate dominator, NONE for roots and unreachable blocks
+        uint32_t order = NONE; // reverse postorder position, NONE when unreachable
+    };
+
+    struct Graph{
+        std::vector<Block> blocks;
+        std::vector<uint32_t> blockOf; // per instruction
+        // Where execution can start: the .global entry, then every call target.
+        // A call is a fall-through edge to its return site, the callee is a root.
+        std::vector<uint32_t> roots;
+
+        bool reachable(uint32_t b) const{ return blocks[b].order != NONE; }
+        // Every path from a root to b goes through a
+        bool dominates(uint32_t a, uint32_t b) const;
+    };
+
+    Graph build(const Machine& m);
+
+    // Graphviz dot: one box per block with its source lines, jumps solid and
+    // fall-throughs dashed. With hits (from --stats) blocks show how often they ran.
+    void writeDot(const Graph& g, const Machine& m, const std::string& name, std::ostream& out,
+                  const std::vector<uint64_t>* hits = nullptr);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Reroller.hpp"
+#include "TraceLine.hpp"
+
+// Emission stage that drops writes nobody observes. A line whose only effect is
+// loading registers (or storing a constant) is held back until its value is
+// either read - by a later line, a call, int $0x80 or the end of the program -
+// and then written, or overwritten first and dropped. Every other line passes
+// through in order as soon as everything before it is decided.
+class DeadStores{
+public:
+    static constexpr size_t MAX_PENDING = 1 << 14; // past this the oldest line is kept undecided
+    static constexpr size_t MAX_STORES = 64;
+
+    explicit DeadStores(Reroller& next) : next(next){}
+
+    bool enabled = false;
+
+    // Back to an empty trace for a new file
+    void reset();
+
+    void push(const TraceLine& line);
+
+    // Everything still held back is observed by the end of the program
+    void finish();
+
+    uint64_t dropped() const{ return droppedLines; }
+
+private:
+    struct Entry{
+        TraceLine line;
+        uint32_t unread; // lanes still holding this line's value
+        bool decided;
+        bool dead;
+    };
+
+    Entry& at(uint64_t id){ return queue[id - front]; }
+    void drain();
+
+    Reroller& next;
+
+    std::deque<Entry> queue;
+    uint64_t front = 0; // id of queue.front()
+    std::vector<uint64_t> registers; // undecided register loads, their unread lanes never overlap
+    std::vector<uint64_t> stores; // undecided constant stores
+    uint64_t droppedLines = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string_view>
+
+#include "Instruction.hpp"
+#include "Machine.hpp"
+
+Registers::Reg decodeRegister(std::string_view str);
+std::string_view trim(std::string_view str);
+
+// Parses one operand; data labels are looked up in m.labels
+Operands::OperandSpec decodeOperand(const Machine& m, std::string_view str);
+
+// line is one .text line; its Text keeps a copy for the output
+Instr::Instruction decodeLine(const Machine& m, std::string_view line, Instr::Text& text);
+
+// Turns the collected .text lines into fixed records so the run loop never parses.
+// Every label is resolved here, m.entry included; lines that name an undefined label
+// (or can't be decoded) are all reported in one exception, before anything runs.
+void decodeProgram(Machine& m);
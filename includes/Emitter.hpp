@@ -0,0 +1,83 @@
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string_view>
+
+// Output of one conversion. Lines are appended to a contiguous buffer that
+// goes to the sink with a single write() whenever it fills up, integers are
+// formatted with to_chars, so emitting a line never touches iostream
+// formatting or allocates.
+class Emitter{
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    Emitter() : buffer(new char[CAPACITY]){}
+    Emitter(const Emitter&) = delete;
+    Emitter& operator=(const Emitter&) = delete;
+    ~Emitter(){ close(); }
+
+    void open(std::ostream* out, uint64_t cap = UINT64_MAX){
+        close();
+        sink = out;
+        limit = cap;
+        total = 0;
+        seconds = 0;
+    }
+
+    // Writes whatever is buffered and detaches from the sink
+    void close(){
+        flush();
+        sink = nullptr;
+    }
+
+    void flush();
+
+    // Bytes emitted so far, including what is still buffered
+    uint64_t bytes() const{ return total + used; }
+    // Output went past the cap given to open(); the sink only got the first cap bytes
+    bool overflowed() const{ return bytes() > limit; }
+
+    bool timed = false; // measure the time spent writing to the sink
+    // Seconds spent in writes to the sink since open(), when timed
+    double writeSeconds() const{ return seconds; }
+
+    void put(std::string_view str){
+        if(used + str.size() > CAPACITY){
+            flush();
+            if(str.size() > CAPACITY){
+                write(str.data(), str.size());
+                return;
+            }
+        }
+        std::memcpy(buffer.get() + used, str.data(), str.size());
+        used += str.size();
+    }
+
+    void put(char c){
+        if(used == CAPACITY) flush();
+        buffer[used++] = c;
+    }
+
+    void putInt(int64_t value){
+        if(CAPACITY - used < 20) flush();
+        used = std::to_chars(buffer.get() + used, buffer.get() + CAPACITY, value).ptr - buffer.get();
+    }
+
+    Emitter& operator<<(std::string_view str){ put(str); return *this; }
+    Emitter& operator<<(char c){ put(c); return *this; }
+
+private:
+    void write(const char* data, size_t size);
+
+    std::unique_ptr<char[]> buffer;
+    size_t used = 0;
+    std::ostream* sink = nullptr;
+    uint64_t total = 0; // bytes handed to write()
+    uint64_t limit = UINT64_MAX;
+    double seconds = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+
+// EFLAGS, evaluated lazily: an instruction that sets flags only records what it
+// did (operation, operand size, operands, result) and CF/ZF/SF/OF/PF are worked
+// out when a jcc, setcc, cmov, adc or sbb reads them. Most results are never
+// read, so most instructions cost a few stores.
+namespace Flags{
+    // Condition codes in the x86 encoding order: the low bit negates the one before
+    enum class Cond : uint8_t{
+        O, NO,
+        B, AE,
+        E, NE,
+        BE, A,
+        S, NS,
+        P, NP,
+        L, GE,
+        LE, G,
+        NONE
+    };
+
+    enum class Op : uint8_t{
+        CLEAR, // every flag 0 (start of a conversion, after div)
+        ADD, // adc too, with the carry in
+        SUB, // cmp, sbb
+        LOGIC, // and, or, xor, test: CF = OF = 0
+        INC, // CF is kept
+        DEC,
+        SHL,
+        SHR,
+        SAR,
+        MUL // CF = OF = upper half is not 0
+    };
+
+    class Lazy{
+    public:
+        // a op b = result, all truncated to size bytes when read; carry is the
+        // incoming CF for ADD/SUB (adc/sbb), the kept CF for INC/DEC, CF = OF for MUL,
+        // b is the shift count for shifts
+        void set(Op op, uint8_t size, uint32_t a, uint32_t b, uint32_t result, bool carry = false){
+            this->op = op;
+            this->size = size;
+            this->carry = carry;
+            this->a = a;
+            this->b = b;
+            this->result = result;
+        }
+
+        void clear(){ set(Op::CLEAR, 4, 0, 0, 1); }
+
+        bool cf() const{
+            const uint32_t mask = this->mask();
+            switch(op){
+                case Op::ADD: return uint64_t(a & mask) + (b & mask) + carry > mask;
+                case Op::SUB: return uint64_t(a & mask) < uint64_t(b & mask) + carry;
+                case Op::INC:
+                case Op::DEC:
+                case Op::MUL: return carry;
+                case Op::SHL: return b <= bits() && ((a & mask) >> (bits() - b)) & 1;
+                case Op::SHR: return b <= bits() && ((a & mask) >> (b - 1)) & 1;
+                case Op::SAR: return (signExtend(a) >> (b < bits() ? b - 1 : bits() - 1)) & 1;
+                default: return false;
+            }
+        }
+
+        bool zf() const{ return op != Op::CLEAR && (result & mask()) == 0; }
+
+        bool sf() const{ return op != Op::CLEAR && (result & sign()); }
+
+        bool of() const{
+            switch(op){
+                case Op::ADD: return (a ^ result) & (b ^ result) & sign();
+                case Op::SUB: return (a ^ b) & (a ^ result) & sign();
+                case Op::INC: return (result & mask()) == sign();
+                case Op::DEC: return (a & mask()) == sign();
+                case Op::MUL: return carry;
+                case Op::SHL: return b == 1 && (bool(result & sign()) != cf()); // only defined for 1
+                case Op::SHR: return b == 1 && (a & sign());
+                default: return false;
+            }
+        }
+
+        // Even number of 1 bits in the low byte
+        bool pf() const{
+            if(op == Op::CLEAR) return false;
+            uint8_t v = static_cast<uint8_t>(result);
+            v ^= v >> 4;
+            v ^= v >> 2;
+            v ^= v >> 1;
+            return !(v & 1);
+        }
+
+        bool test(Cond cond) const{
+            bool r;
+            switch(static_cast<Cond>(static_cast<uint8_t>(cond) & ~1)){
+                case Cond::O: r = of(); break;
+                case Cond::B: r = cf(); break;
+                case Cond::E: r = zf(); break;
+                case Cond::BE: r = cf() || zf(); break;
+                case Cond::S: r = sf(); break;
+                case Cond::P: r = pf(); break;
+                case Cond::L: r = sf() != of(); break;
+                case Cond::LE: r = zf() || sf() != of(); break;
+                default: return false;
+            }
+            return r != (static_cast<uint8_t>(cond) & 1);
+        }
+
+    private:
+        uint32_t bits() const{ return size * 8u; }
+        uint32_t mask() const{ return size == 4 ? 0xFFFFFFFFu : (1u << bits()) - 1; }
+        uint32_t sign() const{ return 1u << (bits() - 1); }
+        int32_t signExtend(uint32_t v) const{
+            return size == 4 ? static_cast<int32_t>(v) : size == 2 ? int16_t(v) : int8_t(v);
+        }
+
+        Op op = Op::CLEAR;
+        uint8_t size = 4;
+        bool carry = false;
+        uint32_t a = 0, b = 0, result = 1;
+    };
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+
+#include "Machine.hpp"
+
+// A program image: what loadSource and decodeProgram leave in a machine, written
+// out once so later runs skip lexing and decoding. It holds the decoded
+// instructions (handlers and jump targets resolved), their output text, the
+// .data and .text labels, the initialized .data bytes, the .global entry, and
+// the output and diagnostics loading produced before the program runs.
+//
+// Records are stored in the host's layout and copied out as they are; strings
+// are views into the image, so a mapped image (Source::Text) costs about the
+// page faults of reading it. An image only loads into the build that wrote it
+// (same record layout and handler numbering).
+namespace Image{
+    constexpr std::string_view MAGIC = "MOVFIMG1"; // first bytes of every image
+    constexpr std::string_view EXTENSION = ".mfi";
+
+    // Whether text starts like an image, not like a source
+    bool is(std::string_view text);
+
+    // m after decodeProgram, before it runs. prologue is everything m.out got so far,
+    // diagnostics what loading reported. Throws for programs too large for the format.
+    void write(const Machine& m, std::string_view prologue, std::string_view diagnostics, std::ostream& out);
+
+    // In place of loadSource and decodeProgram: emits the prologue to m.out and the
+    // diagnostics to m.err. Labels and texts are views into image, which has to stay
+    // alive until m is reset. Throws on an image that is damaged or from another build.
+    void load(Machine& m, std::string_view image);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "Machine.hpp"
+
+namespace Instr{
+    // A conversion went past one of Machine::limits
+    struct LimitExceeded : std::runtime_error{
+        using std::runtime_error::runtime_error;
+    };
+
+    // Runs the decoded program from entry until eip walks off its end;
+    // throws LimitExceeded when it goes past one of m.limits
+    void run(Machine& m, uint32_t entry);
+}
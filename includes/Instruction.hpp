@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Flags.hpp"
+#include "Registers.hpp"
+#include "TraceLine.hpp"
+
+namespace Operands{
+    enum class OperandType : uint8_t{
+        REGISTER,
+        IMMEDIATE,
+        ADDRESS,
+        NONE
+    };
+
+    // Operand decoded once from its text; memory addresses are computed from the live registers when executed
+    struct OperandSpec{
+        OperandType type = OperandType::NONE;
+        Registers::Reg regTag;
+        int32_t imm; // value for IMMEDIATE, displacement for ADDRESS
+        Registers::Reg base = Registers::COUNT; // COUNT = no register
+        Registers::Reg index = Registers::COUNT;
+        uint8_t scale = 1;
+        bool isLabel = false; // $label immediate
+    };
+}
+
+namespace Instr{
+    enum class Type : uint8_t{
+        LABEL,
+        VERBATIM, // copied to the output as written (int, lines using %esp)
+        UNKNOWN,
+        MOV,
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        AND,
+        OR,
+        XOR,
+        INC,
+        DEC,
+        SHL,
+        SHR,
+        SAR,
+        LEA,
+        PUSH,
+        POP,
+        TEST,
+        CMP,
+        ADC,
+        SBB,
+        SETCC,
+        CMOVCC,
+        JCC, // j<cc>, the condition is in Instruction::cond
+        JMP,
+        LOOP,
+        CALL,
+        RET
+    };
+
+    // Operand text as written in the source, only needed when emitting.
+    // The views point into storage, or into the program image it was loaded from.
+    struct Text{
+        std::string_view line;
+        std::string_view mnemonic;
+        std::string_view src;
+        std::string_view dest;
+
+        // Rendered once when decoding, so handlers only append the computed value
+        std::string_view written; // line emitted unchanged: "subl %eax, x\n", "pushl %ebx\n"
+        std::string_view tail; // rest of "movl $<value>, %ebx\n" after the value
+
+        // What the emitted line does, for the passes over the trace
+        uint32_t reads = 0;
+        uint32_t writes = 0;
+        uint8_t traceFlags = 0;
+
+        std::string storage; // the line and the rendered parts, when decoded from source
+    };
+
+    // One decoded line of .text; built once before execution
+    struct Instruction{
+        Type type;
+        uint8_t size;
+        bool external; // call to a label that is not in .text (printf, fflush...)
+        uint32_t target; // resolved label index for jumps and calls
+        uint16_t handler; // handlerId(type, src kind, dest kind)
+        Flags::Cond cond; // for jcc, setcc, cmov
+        
+        Operands::OperandSpec src;
+        Operands::OperandSpec dest;
+        const Text* text;
+    };
+
+    // Every (type, src kind, dest kind) combination has its own handler
+    constexpr uint16_t handlerId(Type type, Operands::OperandType s, Operands::OperandType d){
+        return static_cast<uint16_t>((static_cast<uint16_t>(type) << 4) |
+                                     (static_cast<uint16_t>(s) << 2) |
+                                      static_cast<uint16_t>(d));
+    }
+    constexpr uint16_t HANDLER_COUNT = handlerId(Type::RET, Operands::OperandType::NONE, Operands::OperandType::NONE) + 1;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Machine;
+
+// Native code needs an x86-64 host that can map executable memory
+#ifndef HOST_JIT
+    #if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+        #define HOST_JIT 1
+    #else
+        #define HOST_JIT 0
+    #endif
+#endif
+
+// --jit: hot loops are translated to x86-64 code. A loop is the code from a
+// label to the jcc, jmp or loop that jumps back to it; once its back edge has
+// been taken HOT times it is compiled as a whole, with the eight guest
+// registers held in host registers and memory reached through the page table
+// of the guest memory. The native code runs until it leaves the loop, its
+// budget runs out or an access needs the interpreter (a new page, an address
+// out of range), always stopping before an instruction, so the interpreter
+// picks up exactly there. Every instruction that emits something leaves a
+// Record, which the interpreter turns into the lines its handler would have
+// written. Loops using anything else (calls, the stack, 8/16 bit operands,
+// mul/div, flags read before they are set in the loop) stay interpreted.
+class Jit{
+public:
+    static constexpr uint32_t HOT = 64; // back edges taken before a loop is compiled
+    static constexpr uint32_t MAX_LENGTH = 1024; // instructions in one loop
+    static constexpr uint32_t LOG_SIZE = 1 << 14; // records between two replays
+
+    // Instruction index plus the value and address its handler would have emitted
+    struct Record{
+        uint32_t index;
+        int32_t value;
+        uint32_t address;
+    };
+
+    bool enabled = false;
+
+    static bool supported(){ return HOST_JIT; }
+
+    Jit() = default;
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    ~Jit();
+
+    void reset();
+
+    // Called when the back edge at branch was taken: eip is at the loop head and
+    // budget instructions may still run. Runs the loop natively when it is hot
+    // and compiled, leaving registers, memory, flags and eip as the interpreter
+    // would. Returns how many instructions ran; their records are in log().
+    uint64_t run(Machine& m, uint32_t branch, uint64_t budget);
+
+    const std::vector<Record>& log() const{ return records; }
+    size_t logged() const{ return used; }
+
+private:
+    static constexpr int32_t UNKNOWN = -1, REJECTED = -2;
+
+    struct Code{
+        void* memory;
+        size_t size;
+        uint32_t length; // instructions in the loop
+    };
+
+    bool compile(const Machine& m, uint32_t branch, Code& code);
+
+    std::vector<uint32_t> heat; // per back edge, times taken while cold
+    std::vector<int32_t> codeOf; // per back edge: index in codes, UNKNOWN or REJECTED
+    std::vector<Code> codes;
+    std::vector<Record> records;
+    size_t used = 0;
+};
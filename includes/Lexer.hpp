@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+// Splitting source text without copying it: every piece is a view into the text
+namespace Lexer{
+    constexpr std::string_view BLANK = " \t\r\n";
+
+    inline std::string_view trim(std::string_view str, std::string_view blank = " \t"){
+        size_t first = str.find_first_not_of(blank);
+        if(first == std::string_view::npos) return {};
+        return str.substr(first, str.find_last_not_of(blank) - first + 1);
+    }
+
+    // The next line of text without its '\n'; text moves past it
+    inline std::string_view line(std::string_view& text){
+        size_t end = text.find('\n');
+        std::string_view result = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        return result;
+    }
+
+    // The next run of characters that are not in separators; rest moves past it.
+    // Empty when rest holds only separators.
+    inline std::string_view word(std::string_view& rest, std::string_view separators = BLANK){
+        size_t first = rest.find_first_not_of(separators);
+        if(first == std::string_view::npos){
+            rest = {};
+            return {};
+        }
+        size_t end = rest.find_first_of(separators, first);
+        std::string_view result = rest.substr(first, end == std::string_view::npos ? end : end - first);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end);
+        return result;
+    }
+
+    // Reads an integer the way strtoul does: leading blanks and a sign are allowed,
+    // base 0 takes 0x for hex and a leading 0 for octal, the value wraps to 32 bits.
+    // False when str doesn't start with a number.
+    inline bool number(std::string_view str, uint32_t& value, int base = 0){
+        size_t i = str.find_first_not_of(BLANK);
+        if(i == std::string_view::npos) return false;
+        bool negative = str[i] == '-';
+        if(str[i] == '-' || str[i] == '+') i++;
+        auto hexPrefix = [&]{
+            return i + 2 < str.size() && str[i] == '0' && (str[i + 1] == 'x' || str[i + 1] == 'X')
+                && std::isxdigit(static_cast<unsigned char>(str[i + 2]));
+        };
+        if(base == 0) base = hexPrefix() ? 16 : i < str.size() && str[i] == '0' ? 8 : 10;
+        if(base == 16 && hexPrefix()) i += 2;
+        uint64_t parsed;
+        if(std::from_chars(str.data() + i, str.data() + str.size(), parsed, base).ec != std::errc()) return false;
+        value = static_cast<uint32_t>(negative ? 0 - parsed : parsed);
+        return true;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <istream>
+#include <string_view>
+
+#include "Machine.hpp"
+
+// Reads a source file into m: .data is laid out in memory and labels, .text lines
+// are collected for decodeProgram. Section directives and .data lines are copied to m.out.
+// Labels and lines are views into text, which has to stay alive until m is reset
+// (m.source holds the file convertFile maps).
+void loadSource(Machine& m, std::string_view text);
+// Keeps a copy of the stream in m.source
+void loadSource(Machine& m, std::istream& in);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Flags.hpp"
+#include "Registers.hpp"
+
+struct Machine;
+
+// --summarize-loops: counted loops run in closed form instead of one iteration
+// at a time. A loop is the straight-line code from a label to the jcc or loop
+// that jumps back to it. When everything in it is affine in the 32 bit
+// registers and fixed memory words it uses, one iteration is a map
+// S -> A*S + b over them; a register only ever shifted right by a constant and
+// movl stores through (base, index, scale) are followed on the side. The trip
+// count is solved from the exit compare, all iterations but the last are
+// applied at once and emitted as moves of their net effect, and the last one
+// runs normally, so flags and the code after the loop see exactly what a full
+// run would leave.
+class LoopSummary{
+public:
+    static constexpr size_t MAX_SLOTS = 16; // registers and memory words one loop may use
+    static constexpr uint32_t MAX_BODY = 256; // instructions per iteration
+    static constexpr uint64_t MAX_FILL = 1 << 20; // iterations stepped one by one when the loop stores through an index
+    static constexpr uint32_t MAX_MISSES = 64; // a loop that never can be skipped stops being tried
+
+    bool enabled = false;
+
+    void reset();
+
+    // Called when the back edge at branch was taken: eip is at the loop head and
+    // budget instructions may still run. Moves the machine to the start of the
+    // last iteration when it can, false when the loop has to run normally.
+    bool fastForward(Machine& m, uint32_t branch, uint64_t budget);
+
+    // c + sum of coef[j] * S[j], modulo 2^32
+    struct Form{
+        std::array<uint32_t, MAX_SLOTS> coef{};
+        uint32_t c = 0;
+    };
+    using State = std::array<uint32_t, MAX_SLOTS>;
+
+    enum class Shift : uint8_t{ NONE, SHR, SAR };
+
+    struct Slot{
+        Registers::Reg reg; // COUNT for a memory word
+        uint32_t address;
+        bool written = false;
+        Shift shift = Shift::NONE; // only shifted right by shiftBy once per iteration, read by nothing
+        uint32_t shiftBy = 0;
+        std::string tail; // ", %ecx\n", ", x+4\n": the rest of the move that sets it
+    };
+
+    // movl value, (base, index, scale)
+    struct Fill{
+        Form address;
+        Form value;
+    };
+
+    // What one loop does per iteration, worked out the first time its back edge is taken
+    struct Plan{
+        uint32_t head;
+        uint32_t length; // instructions per iteration, head label and branch included
+        std::vector<Slot> slots;
+        std::array<Form, MAX_SLOTS> next; // slot values after one iteration
+        std::vector<Fill> fills;
+        // The branch jumps back while the last compare of a with b satisfies cond,
+        // or while the shifted slot is not 0 yet
+        Form a, b;
+        Flags::Cond cond = Flags::Cond::NONE;
+        int32_t shifted = -1;
+        uint32_t misses = 0; // fastForward failures in a row
+    };
+
+private:
+    static constexpr int32_t UNKNOWN = -1, REJECTED = -2;
+
+    bool analyze(const Machine& m, uint32_t branch, Plan& plan);
+    bool skip(Machine& m, Plan& plan, uint64_t budget);
+    std::string addressText(const Machine& m, uint32_t address);
+    void emit(Machine& m, const Plan& plan, uint32_t value, std::string_view tail,
+              uint32_t writes, uint8_t flags, uint32_t address);
+
+    std::vector<int32_t> planOf; // per instruction: index in plans for a back edge, UNKNOWN or REJECTED
+    std::deque<Plan> plans;
+    std::vector<std::pair<uint32_t, std::string_view>> dataLabels; // by address, for naming stores
+    std::deque<std::string> texts; // tails of traced stores into filled memory
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "DeadStores.hpp"
+#include "Emitter.hpp"
+#include "Flags.hpp"
+#include "Instruction.hpp"
+#include "Jit.hpp"
+#include "LoopSummary.hpp"
+#include "Memory.hpp"
+#include "Registers.hpp"
+#include "Reroller.hpp"
+#include "Source.hpp"
+#include "Stats.hpp"
+
+// Everything one conversion reads or writes. Machines share no state,
+// so independent conversions can run on different threads.
+struct Machine{
+    // The file being converted: label names and .text lines are views into it
+    Source::Text source;
+
+    Registers::File regs;
+
+    uint64_t memorySize = Mem::DEFAULT_SIZE;
+    Mem::PagedMemory memory; //start -> end memoria principala, end->start stiva
+    uint32_t memoryPeak = 0;
+    std::unordered_map<std::string_view, Mem::Label> labels;
+
+    Flags::Lazy flags;
+
+    std::vector<std::string_view> instructions; // .text lines, without the '\n'
+    std::vector<Instr::Text> texts;
+    std::vector<Instr::Instruction> program;
+    std::unordered_map<std::string_view, uint32_t> instr_labels;
+    std::string_view currentLabel;
+    uint32_t entry = 0; // index of the .global label, set by decodeProgram
+
+    Emitter out;
+    // Passes between the handlers and out, each only when enabled
+    Reroller reroll{out};
+    DeadStores deadStores{reroll};
+    std::ostream* err = &std::cerr; // runtime diagnostics
+
+    // A conversion is stopped when it goes past one of these, 0 = no limit
+    struct Limits{
+        uint64_t instructions = 0;
+        double seconds = 0;
+        uint64_t outputBytes = 0;
+    } limits;
+    std::chrono::steady_clock::time_point started;
+    uint64_t executed = 0; // instructions run
+
+    LoopSummary loops; // --summarize-loops
+    Jit jit; // --jit
+
+    Stats::Counters stats; // --stats
+
+    unsigned threads = 1; // for loading and decoding one large file
+
+    explicit Machine(uint64_t memorySize = Mem::DEFAULT_SIZE) : memorySize(memorySize){}
+
+    bool tracing() const{ return deadStores.enabled || reroll.enabled; }
+
+    void trace(const TraceLine& line){
+        if(deadStores.enabled) deadStores.push(line);
+        else reroll.push(line);
+    }
+
+    // Emits the lines the passes still hold back
+    void finishTrace(){
+        deadStores.finish();
+        reroll.finish();
+    }
+
+    // Back to a clean machine before reading a new file
+    void reset(){
+        flags.clear();
+        instructions.clear();
+        texts.clear();
+        program.clear();
+        instr_labels.clear();
+        currentLabel = {};
+        entry = 0;
+
+        regs = Registers::File{};
+        regs.esp = static_cast<int32_t>(memorySize);
+
+        memory.reset(memorySize);
+        memoryPeak = 0;
+        labels.clear();
+
+        out.open(nullptr); // bytes() counts from zero
+        reroll.reset();
+        deadStores.reset();
+
+        executed = 0;
+        loops.reset();
+        jit.reset();
+        stats.reset();
+        source.close();
+        started = std::chrono::steady_clock::now();
+    }
+};
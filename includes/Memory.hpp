@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Mem{
+    constexpr uint64_t DEFAULT_SIZE = 1048576; //1024*1024 = 1MiB
+    constexpr uint64_t MAX_SIZE = uint64_t(1) << 32; // the guest has 32 bit addresses
+    constexpr uint32_t PAGE_BITS = 12;
+    constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS; // 4 KiB
+
+    struct Label{
+        uint8_t size;
+        uint32_t address;
+    };
+
+    // Sparse guest memory: a page is allocated the first time it is written,
+    // until then it reads from the shared zero page. Reset only frees touched pages.
+    class PagedMemory{
+    public:
+        void reset(uint64_t newSize);
+
+        uint64_t size() const{ return memSize; }
+        size_t touchedPages() const{ return touched.size(); }
+
+        // For native code that reaches memory itself (--jit): page n starts at
+        // pages()[n], and a page still at zero() is shared and not writable yet
+        const uint8_t* const* pages() const{ return readPages.data(); }
+        static const uint8_t* zero(){ return zeroPage; }
+
+        uint8_t read(uint32_t addr) const{
+            check(addr, 1);
+            return readPages[addr >> PAGE_BITS][addr & (PAGE_SIZE - 1)];
+        }
+
+        void write(uint32_t addr, uint8_t value){
+            check(addr, 1);
+            writablePage(addr >> PAGE_BITS)[addr & (PAGE_SIZE - 1)] = value;
+        }
+
+        // Little-endian value of size bytes (1, 2 or 4)
+        uint32_t load(uint32_t addr, uint8_t size) const{
+            check(addr, size);
+            uint32_t offset = addr & (PAGE_SIZE - 1);
+            uint32_t value = 0;
+            if(offset + size <= PAGE_SIZE){
+                const uint8_t* bytes = readPages[addr >> PAGE_BITS] + offset;
+                for(uint8_t i = 0; i < size; i++)
+                    value |= static_cast<uint32_t>(bytes[i]) << (8 * i);
+            }else{
+                for(uint8_t i = 0; i < size; i++)
+                    value |= static_cast<uint32_t>(read(addr + i)) << (8 * i);
+            }
+            return value;
+        }
+
+        // length bytes at once, page by page
+        void write(uint32_t addr, const uint8_t* bytes, size_t length);
+
+        void store(uint32_t addr, uint8_t size, uint32_t value){
+            check(addr, size);
+            uint32_t offset = addr & (PAGE_SIZE - 1);
+            if(offset + size <= PAGE_SIZE){
+                uint8_t* bytes = writablePage(addr >> PAGE_BITS) + offset;
+                for(uint8_t i = 0; i < size; i++, value >>= 8)
+                    bytes[i] = static_cast<uint8_t>(value & 0xFF);
+            }else{
+                for(uint8_t i = 0; i < size; i++, value >>= 8)
+                    write(addr + i, static_cast<uint8_t>(value & 0xFF));
+            }
+        }
+
+    private:
+        static const uint8_t zeroPage[PAGE_SIZE];
+
+        uint64_t memSize = 0;
+        std::vector<const uint8_t*> readPages;
+        std::vector<std::unique_ptr<uint8_t[]>> owned;
+        std::vector<std::unique_ptr<uint8_t[]>> freePages; // reused by the next file
+        std::vector<uint32_t> touched;
+
+        void check(uint32_t addr, uint64_t size) const{
+            if(static_cast<uint64_t>(addr) + size > memSize)
+                throw std::runtime_error("Memory access out of range at address " + std::to_string(addr));
+        }
+
+        uint8_t* writablePage(uint32_t page){
+            if(owned[page]) return owned[page].get();
+            return allocatePage(page);
+        }
+        uint8_t* allocatePage(uint32_t page);
+    };
+}
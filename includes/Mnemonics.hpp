@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "Instruction.hpp"
+#include "PerfectHash.hpp"
+
+namespace Mnemonics{
+    enum class Form : uint8_t{
+        NONE, // ret
+        ONE, // incl %eax
+        TWO, // addl %eax, %ebx
+        TARGET, // jmp et_loop
+        VERBATIM // int $0x80
+    };
+
+    struct Entry{
+        std::string_view name; // without the l/w/b suffix
+        Instr::Type type;
+        Form form;
+        bool sized; // accepts the l/w/b suffix
+        Flags::Cond cond = Flags::Cond::NONE; // j<cc>, set<cc>, cmov<cc>
+    };
+
+    // Every spelling of a condition code
+    #define MNEMONIC_CONDITIONS(X) \
+        X(o, O) X(no, NO) \
+        X(b, B) X(c, B) X(nae, B) X(ae, AE) X(nb, AE) X(nc, AE) \
+        X(e, E) X(z, E) X(ne, NE) X(nz, NE) \
+        X(be, BE) X(na, BE) X(a, A) X(nbe, A) \
+        X(s, S) X(ns, NS) X(p, P) X(pe, P) X(np, NP) X(po, NP) \
+        X(l, L) X(nge, L) X(ge, GE) X(nl, GE) \
+        X(le, LE) X(ng, LE) X(g, G) X(nle, G)
+    #define MNEMONIC_JCC(CC, COND) {"j" #CC, Instr::Type::JCC, Form::TARGET, false, Flags::Cond::COND},
+    #define MNEMONIC_SETCC(CC, COND) {"set" #CC, Instr::Type::SETCC, Form::ONE, false, Flags::Cond::COND},
+    #define MNEMONIC_CMOVCC(CC, COND) {"cmov" #CC, Instr::Type::CMOVCC, Form::TWO, true, Flags::Cond::COND},
+
+    constexpr Entry entries[] = {
+        {"mov", Instr::Type::MOV, Form::TWO, true},
+        {"add", Instr::Type::ADD, Form::TWO, true},
+        {"sub", Instr::Type::SUB, Form::TWO, true},
+        {"div", Instr::Type::DIV, Form::ONE, true},
+        {"mul", Instr::Type::MUL, Form::ONE, true},
+        {"or", Instr::Type::OR, Form::TWO, true},
+        {"xor", Instr::Type::XOR, Form::TWO, true},
+        {"and", Instr::Type::AND, Form::TWO, true},
+        {"inc", Instr::Type::INC, Form::ONE, true},
+        {"dec", Instr::Type::DEC, Form::ONE, true},
+        {"lea", Instr::Type::LEA, Form::TWO, true},
+        {"push", Instr::Type::PUSH, Form::ONE, true},
+        {"pop", Instr::Type::POP, Form::ONE, true},
+        {"test", Instr::Type::TEST, Form::TWO, true},
+        {"cmp", Instr::Type::CMP, Form::TWO, true},
+        {"adc", Instr::Type::ADC, Form::TWO, true},
+        {"sbb", Instr::Type::SBB, Form::TWO, true},
+        {"sar", Instr::Type::SAR, Form::TWO, true},
+        {"shr", Instr::Type::SHR, Form::TWO, true},
+        {"shl", Instr::Type::SHL, Form::TWO, true},
+        MNEMONIC_CONDITIONS(MNEMONIC_JCC)
+        MNEMONIC_CONDITIONS(MNEMONIC_SETCC)
+        MNEMONIC_CONDITIONS(MNEMONIC_CMOVCC)
+        {"jmp", Instr::Type::JMP, Form::TARGET, false},
+        {"loop", Instr::Type::LOOP, Form::TARGET, false},
+        {"call", Instr::Type::CALL, Form::TARGET, false},
+        {"ret", Instr::Type::RET, Form::NONE, false},
+        {"int", Instr::Type::VERBATIM, Form::VERBATIM, false},
+    };
+    constexpr size_t COUNT = sizeof(entries) / sizeof(entries[0]);
+    #undef MNEMONIC_CONDITIONS
+    #undef MNEMONIC_JCC
+    #undef MNEMONIC_SETCC
+    #undef MNEMONIC_CMOVCC
+
+    constexpr std::array<std::string_view, COUNT> names(){
+        std::array<std::string_view, COUNT> n{};
+        for(size_t i = 0; i < COUNT; i++) n[i] = entries[i].name;
+        return n;
+    }
+    constexpr auto index = PerfectHash::build(names());
+    static_assert(index.ok, "Mnemonics have no perfect hash, change PerfectHash::hash");
+
+    // Entry for a mnemonic, with the operand size given by its suffix (l = 4, w = 2, b = 1)
+    inline const Entry* lookup(std::string_view name, uint8_t& size){
+        int idx = index.find(name);
+        if(idx >= 0){
+            size = 4;
+            return &entries[idx];
+        }
+        if(name.size() < 2) return nullptr;
+
+        uint8_t suffixSize = 0;
+        switch(name.back()){
+            case 'l': suffixSize = 4; break;
+            case 'w': suffixSize = 2; break;
+            case 'b': suffixSize = 1; break;
+        }
+        idx = suffixSize ? index.find(name.substr(0, name.size() - 1)) : -1;
+        if(idx < 0 || !entries[idx].sized) return nullptr;
+        size = suffixSize;
+        return &entries[idx];
+    }
+}
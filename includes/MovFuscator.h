@@ -0,0 +1,55 @@
+#ifndef MOVFUSCATOR_H
+#define MOVFUSCATOR_H
+
+/* C interface to the converter, for callers that can't use MovFuscator.hpp.
+   A converter keeps its machine warm between calls; use one per thread. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct movfuscator_converter movfuscator_converter;
+
+typedef struct movfuscator_options{
+    uint64_t memory_size; /* bytes of guest memory, 4K..4G */
+    int reroll;
+    int dead_stores;
+    int summarize_loops;
+    int jit;
+    uint64_t max_instructions; /* 0 = no limit */
+    uint64_t max_output; /* bytes, 0 = no limit */
+    double time_limit; /* seconds, 0 = no limit */
+    unsigned threads; /* for loading and decoding a large source */
+} movfuscator_options;
+
+/* Receives the converted text in order, in blocks */
+typedef void (*movfuscator_write)(void* context, const char* data, size_t size);
+
+/* The defaults of the command line tool */
+void movfuscator_default_options(movfuscator_options* options);
+
+/* NULL when the options are invalid or memory runs out; options may be NULL for the defaults */
+movfuscator_converter* movfuscator_new(const movfuscator_options* options);
+void movfuscator_free(movfuscator_converter* converter);
+
+/* Converts length bytes of source. Returns 0 when the conversion finished,
+   -1 when it stopped with an error (see movfuscator_error); what was produced
+   until then has been written either way. */
+int movfuscator_convert(movfuscator_converter* converter, const char* source, size_t length,
+                        movfuscator_write write, void* context);
+
+/* Of the last conversion, valid until the next one: the error ("" when none)
+   and the runtime messages the tool would print on stderr */
+const char* movfuscator_error(const movfuscator_converter* converter);
+const char* movfuscator_diagnostics(const movfuscator_converter* converter);
+/* Instructions run by the last conversion */
+uint64_t movfuscator_executed(const movfuscator_converter* converter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
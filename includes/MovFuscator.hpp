@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "Machine.hpp"
+
+// The converter as a library: source text in, converted text out, no files.
+// MovFuscator (the command line tool) is a thin wrapper over this.
+namespace MovFuscator{
+    // Receives the converted text in order, in blocks of up to Emitter::CAPACITY bytes.
+    // write() must not throw: a conversion stops only on its own errors and limits.
+    class Sink{
+    public:
+        virtual ~Sink() = default;
+        virtual void write(const char* data, size_t size) = 0;
+    };
+
+    // Appends everything to a string
+    class StringSink : public Sink{
+    public:
+        std::string text;
+        void write(const char* data, size_t size) override{ text.append(data, size); }
+    };
+
+    // Forwards to a stream (a file, std::cout). With flush, every block is pushed
+    // on at once, so a pipe sees the output while the conversion still runs.
+    class StreamSink : public Sink{
+    public:
+        explicit StreamSink(std::ostream& out, bool flush = false) : out(out), flush(flush){}
+        void write(const char* data, size_t size) override{
+            out.write(data, static_cast<std::streamsize>(size));
+            if(flush) out.flush();
+        }
+    private:
+        std::ostream& out;
+        bool flush;
+    };
+
+    struct Options{
+        uint64_t memorySize = Mem::DEFAULT_SIZE;
+        bool reroll = false;
+        bool deadStores = false;
+        bool summarizeLoops = false;
+        bool jit = false; // ignored where native code isn't supported
+        Machine::Limits limits;
+        bool stats = false; // collect --stats counters in machine().stats
+        unsigned threads = 1; // for loading and decoding a large source
+    };
+
+    struct Result{
+        std::string error; // empty when the conversion finished
+        std::string diagnostics; // runtime messages, what the tool prints on stderr
+        bool decoded = false; // the program got past decoding
+        uint64_t executed = 0; // instructions run
+        uint64_t bytes = 0; // output produced, before --max-output cut it
+
+        bool ok() const{ return error.empty(); }
+    };
+
+    // Keeps one machine warm between conversions: memory pages, buffers and
+    // tables are reused, so converting many small sources costs little more
+    // than running them. One converter is used by one thread at a time;
+    // converters share nothing.
+    class Converter{
+    public:
+        explicit Converter(const Options& options = {});
+
+        // source only has to stay alive during the call. A source that is a program
+        // image (Image::is) is loaded as it is, without lexing or decoding.
+        // With image, the decoded program is also written there as an image before it
+        // runs; nothing is written when it doesn't decode or the output cap is hit first.
+        Result convert(std::string_view source, Sink& out, Sink* image = nullptr);
+
+        // The machine after the last conversion: its decoded program, stats
+        const Machine& machine() const{ return m; }
+
+    private:
+        Machine m;
+        std::ostringstream diagnostics;
+    };
+
+    // One conversion with a fresh machine
+    Result convert(std::string_view source, Sink& out, const Options& options = {});
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Instruction.hpp"
+#include "Machine.hpp"
+
+namespace Operands{
+    struct Operand{
+        OperandType type;
+        uint8_t size;
+        int32_t imm;
+        uint32_t address; 
+        Registers::Reg regTag;
+    };
+
+    // Specialized on the operand kind, the handlers know it from decoding and never switch on it
+    template<OperandType T>
+    int32_t readOperand(const Machine& m, const Operand& op){
+        if constexpr(T == OperandType::REGISTER){
+            const Registers::RegDef& registerData = Registers::regData[op.regTag];
+            uint32_t mask = generateMask(registerData.size);
+            return (m.regs.*registerData.base_register>>registerData.offset) & mask;
+        }else if constexpr(T == OperandType::ADDRESS){
+            uint32_t value = m.memory.load(op.address, op.size);
+
+            if(op.size == 1) return (int32_t)(int8_t)value;
+            else if(op.size == 2) return (int32_t)(int16_t)value;
+            return (int32_t) value;
+        }else if constexpr(T == OperandType::IMMEDIATE){
+            return op.imm;
+        }else{
+            return 0;
+        }
+    }
+
+    template<OperandType T>
+    void writeOperand(Machine& m, const Operand& op, int32_t value){
+        if constexpr(T == OperandType::REGISTER){
+            const Registers::RegDef& registerData = Registers::regData[op.regTag];
+            uint32_t mask = generateMask(registerData.size) << registerData.offset;
+            int32_t& reg = m.regs.*registerData.base_register;
+
+            reg = (reg & ~mask) |
+                  ((static_cast<uint32_t>(value) << registerData.offset) & mask);
+        }else if constexpr(T == OperandType::ADDRESS){
+            m.memory.store(op.address, op.size, static_cast<uint32_t>(value));
+        }
+    }
+
+    template<OperandType T>
+    Operand resolve(const Machine& m, const OperandSpec& spec, uint8_t size){
+        if constexpr(T == OperandType::REGISTER){
+            return {.type=T, .size=size, .regTag=spec.regTag};
+        }else if constexpr(T == OperandType::IMMEDIATE){
+            return {.type=T, .size=size, .imm=spec.imm};
+        }else if constexpr(T == OperandType::ADDRESS){
+            uint32_t addr = static_cast<uint32_t>(spec.imm);
+            if(spec.base != Registers::COUNT)
+                addr += static_cast<uint32_t>(m.regs.*Registers::regData[spec.base].base_register);
+            if(spec.index != Registers::COUNT)
+                addr += static_cast<uint32_t>(m.regs.*Registers::regData[spec.index].base_register) * spec.scale;
+            return {.type=T, .size=size, .address=addr};
+        }else{
+            return {.type=T, .size=size};
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+// Runs task(0) .. task(count - 1) at the same time, task 0 on the calling thread,
+// and returns when all of them are done. Tasks must not throw.
+template<typename Task>
+void parallel(unsigned count, Task&& task){
+    std::vector<std::thread> threads;
+    threads.reserve(count ? count - 1 : 0);
+    for(unsigned i = 1; i < count; i++)
+        threads.emplace_back([&task, i]{ task(i); });
+    if(count) task(0u);
+    for(std::thread& t : threads)
+        t.join();
+}
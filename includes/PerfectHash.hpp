@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Perfect hash over a fixed set of strings, built entirely at compile time
+// (hash and displace: a first hash picks a bucket, every bucket stores the
+// seed of a second hash that sends its keys to free slots).
+// Lookup costs two hashes and one comparison no matter how many keys there are.
+namespace PerfectHash{
+    constexpr uint32_t hash(std::string_view str, uint32_t seed){
+        uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+        for(char c : str){
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr size_t nextPow2(size_t n){
+        size_t p = 1;
+        while(p < n) p <<= 1;
+        return p;
+    }
+
+    template<size_t N>
+    struct Table{
+        static constexpr size_t SLOTS = nextPow2(N * 2);
+        static constexpr size_t BUCKETS = nextPow2(N / 4 + 1);
+        static constexpr int16_t EMPTY = -1;
+
+        std::array<std::string_view, N> keys{};
+        std::array<uint16_t, BUCKETS> seeds{};
+        std::array<int16_t, SLOTS> slots{};
+        bool ok = false;
+
+        // Index of str in keys, -1 if it is not one of them
+        constexpr int find(std::string_view str) const{
+            uint32_t seed = seeds[hash(str, 0) & (BUCKETS - 1)];
+            int16_t idx = slots[hash(str, seed) & (SLOTS - 1)];
+            if(idx == EMPTY || keys[idx] != str) return -1;
+            return idx;
+        }
+    };
+
+    template<size_t N>
+    constexpr Table<N> build(const std::array<std::string_view, N>& keys){
+        Table<N> t{};
+        t.keys = keys;
+        for(auto& s : t.slots) s = Table<N>::EMPTY;
+
+        std::array<size_t, Table<N>::BUCKETS> bucketSize{};
+        for(size_t i = 0; i < N; i++)
+            bucketSize[hash(keys[i], 0) & (Table<N>::BUCKETS - 1)]++;
+
+        // Biggest buckets first, while there are still plenty of free slots
+        for(size_t size = N; size > 0; size--){
+            for(size_t b = 0; b < Table<N>::BUCKETS; b++){
+                if(bucketSize[b] != size) continue;
+
+                bool placed = false;
+                for(uint32_t seed = 1; seed < 0xFFFF && !placed; seed++){
+                    std::array<int16_t, Table<N>::SLOTS> trial = t.slots;
+                    placed = true;
+                    for(size_t i = 0; i < N && placed; i++){
+                        if((hash(keys[i], 0) & (Table<N>::BUCKETS - 1)) != b) continue;
+                        size_t slot = hash(keys[i], seed) & (Table<N>::SLOTS - 1);
+                        if(trial[slot] != Table<N>::EMPTY) placed = false;
+                        else trial[slot] = static_cast<int16_t>(i);
+                    }
+                    if(placed){
+                        t.slots = trial;
+                        t.seeds[b] = static_cast<uint16_t>(seed);
+                    }
+                }
+                if(!placed) return t;
+            }
+        }
+        t.ok = true;
+        return t;
+    }
+}
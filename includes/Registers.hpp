@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+constexpr uint32_t generateMask(uint8_t size){
+    return static_cast<uint32_t>((uint64_t(1) << size) - 1);
+}
+
+namespace Registers{
+    // The register file of one simulated machine
+    struct File{
+        int32_t eax=0, ebx=0, ecx=0, edx=0, esi=0, edi=0, esp=0, ebp=0, eip=0;
+    };
+
+    enum Reg{
+        EAX, AX, AH, AL,
+        EBX, BX, BH, BL,
+        ECX, CX, CH, CL,
+        EDX, DX, DH, DL,
+        ESI,
+        EDI,
+        ESP,
+        EBP,
+        COUNT
+    };
+
+    // Bytes of the register file a register covers, 4 bits per 32 bit register (EAX = 0xF, AH = 0x2)
+    constexpr uint32_t lanes(Reg r){
+        if(r >= COUNT) return 0;
+        if(r >= ESI) return 0xFu << (4 * (r - ESI + 4));
+        constexpr uint32_t part[] = {0xF, 0x3, 0x2, 0x1};
+        return part[r % 4] << (4 * (r / 4));
+    }
+    constexpr uint32_t ALL_LANES = 0xFFFFFFFF;
+
+    struct RegDef{
+        int32_t File::* base_register;
+        uint8_t size;
+        uint16_t offset;
+    };
+
+    inline const RegDef regData[]={
+        [EAX] = {&File::eax, 32, 0},
+        [AX] = {&File::eax, 16, 0},
+        [AH] = {&File::eax, 8, 8},
+        [AL] = {&File::eax, 8, 0},
+
+        [EBX] = {&File::ebx, 32, 0},
+        [BX] = {&File::ebx, 16, 0},
+        [BH] = {&File::ebx, 8, 8},
+        [BL] = {&File::ebx, 8, 0},
+
+        [ECX] = {&File::ecx, 32, 0},
+        [CX] = {&File::ecx, 16, 0},
+        [CH] = {&File::ecx, 8, 8},
+        [CL] = {&File::ecx, 8, 0},
+
+        [EDX] = {&File::edx, 32, 0},
+        [DX] = {&File::edx, 16, 0},
+        [DH] = {&File::edx, 8, 8},
+        [DL] = {&File::edx, 8, 0},
+
+        [ESI] = {&File::esi, 32, 0},
+        [EDI] = {&File::edi, 32, 0},
+        
+        [ESP] = {&File::esp, 32, 0},
+        [EBP] = {&File::ebp, 32, 0}
+    };
+    // Use to transform from text to the tag that we want
+    inline const std::unordered_map<std::string_view, Reg> stringToTag = {
+        {"%eax", EAX}, {"%ax", AX}, {"%ah", AH}, {"%al", AL},
+        {"%ebx", EBX}, {"%bx", BX}, {"%bh", BH}, {"%bl", BL},
+        {"%ecx", ECX}, {"%cx", CX}, {"%ch", CH}, {"%cl", CL},
+        {"%edx", EDX}, {"%dx", DX}, {"%dh", DH}, {"%dl", DL},
+        {"%esi", ESI},
+        {"%edi", EDI},
+        {"%esp", ESP},
+        {"%ebp", EBP}
+    }; 
+}
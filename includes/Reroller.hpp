@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Emitter.hpp"
+#include "TraceLine.hpp"
+
+// Emission stage that turns a periodic trace back into a loop. Every iteration
+// of a simulated loop emits the same lines, so once MIN_REPEATS iterations line
+// up the rest only extends a counter:
+//   - bodies that only load registers with constants collapse to the last iteration
+//   - everything else is written once, then repeated by a counted loop; constants
+//     have to move by a fixed step and become addX $step, %reg
+// Memory use and output size depend on the period, not on how often the loop ran.
+class Reroller{
+public:
+    static constexpr size_t MAX_PERIOD = 64; // lines per iteration
+    static constexpr size_t MIN_REPEATS = 4;
+
+    explicit Reroller(Emitter& out) : out(out){}
+
+    bool enabled = false; // when off, lines go straight to out
+
+    // Back to an empty trace for a new file
+    void reset();
+
+    void push(const TraceLine& line);
+
+    // Emits everything still held back; call before closing the output
+    void finish();
+
+private:
+    static constexpr size_t WINDOW = MAX_PERIOD * (MIN_REPEATS + 1);
+
+    bool startLoop(size_t length);
+    void endLoop();
+    void emit(const TraceLine& line, int64_t value);
+
+    Emitter& out;
+
+    std::deque<TraceLine> pending; // lines not emitted yet, at most WINDOW
+    std::array<size_t, MAX_PERIOD + 1> run{}; // run[p]: trailing lines equal to the line p before them
+
+    // Loop being extended, period == 0 when there is none
+    size_t period = 0;
+    uint64_t repeats = 0;
+    bool collapse = false; // only the last iteration is written
+    std::vector<TraceLine> body; // first iteration
+    std::vector<int64_t> step;
+    std::vector<int64_t> last; // values of the latest complete iteration
+    std::vector<TraceLine> partial; // current iteration so far
+
+    uint32_t loops = 0; // labels used in this file
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "MovFuscator.hpp"
+
+// Unix domain sockets, where the platform has them
+#ifndef UNIX_SOCKETS
+    #if defined(__unix__) || defined(__APPLE__)
+        #define UNIX_SOCKETS 1
+    #else
+        #define UNIX_SOCKETS 0
+    #endif
+#endif
+
+// --serve: a daemon holding warm converters that takes conversions over a Unix
+// domain socket, so a build converting thousands of files pays process startup,
+// guest memory and table setup once. Every conversion uses the options the
+// server was started with.
+//
+// On a connection, any number of requests one after the other:
+//   client: "convert <n>\n", then n bytes of source
+//   server: "out <n>\n" and n bytes of output, as often as needed, then
+//           "done <executed> <d> <e>\n", d bytes of diagnostics and e bytes of error
+//           (e = 0: the conversion finished)
+// Anything else is answered with "bad request\n" and the connection is closed.
+namespace Server{
+    constexpr size_t MAX_SOURCE = size_t(1) << 30; // bytes in one request
+
+    constexpr bool supported(){ return UNIX_SOCKETS; }
+
+    // Listens on path until SIGINT or SIGTERM, with `converters` conversions
+    // running at once. Returns the exit code for main.
+    int serve(const std::string& path, const MovFuscator::Options& options, unsigned converters, std::ostream& log);
+
+    // The other end: sends sources to a server
+    class Client{
+    public:
+        Client() = default;
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+        ~Client();
+
+        // false when no server listens on path, see error()
+        bool connect(const std::string& path);
+        // Output goes to out as it arrives. false when the connection broke,
+        // result is only filled in when it returns true
+        bool convert(std::string_view source, MovFuscator::Sink& out, MovFuscator::Result& result);
+
+        const std::string& error() const{ return problem; }
+
+    private:
+        int fd = -1;
+        std::string pending; // read from the socket, not consumed yet
+        std::string problem;
+    };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Source files are mapped read-only where the platform has mmap, read into
+// memory otherwise. Labels and .text lines are views into the text, so it
+// has to outlive the conversion that loaded it.
+#ifndef MAPPED_SOURCE
+    #if defined(__unix__) || defined(__APPLE__)
+        #define MAPPED_SOURCE 1
+    #else
+        #define MAPPED_SOURCE 0
+    #endif
+#endif
+
+namespace Source{
+    class Text{
+    public:
+        Text() = default;
+        Text(Text&& other) noexcept;
+        Text& operator=(Text&& other) noexcept;
+        Text(const Text&) = delete;
+        Text& operator=(const Text&) = delete;
+        ~Text(){ close(); }
+
+        // false when the file can't be opened
+        bool open(const std::string& path);
+        // Everything on standard input, up to its end
+        bool openStdin();
+        // Takes text that is already in memory (a stream, a test string)
+        void own(std::string text);
+        void close();
+
+        std::string_view view() const{ return {data, length}; }
+
+    private:
+#if MAPPED_SOURCE
+        bool map(int fd); // false when fd is not a regular file that could be mapped
+#endif
+
+        const char* data = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+        std::string owned;
+    };
+}
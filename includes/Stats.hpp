@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Machine;
+
+namespace Stats{
+    // Filled in while a conversion runs, only when enabled
+    struct Counters{
+        bool enabled = false;
+
+        // Wall time per phase, in seconds
+        double data = 0; // .data lines: parsing and laying out memory
+        double text = 0; // collecting .text lines
+        double decode = 0;
+        double run = 0; // execution, without the time spent writing output
+        double emit = 0; // writing output, flushing the trace passes
+
+        std::vector<uint64_t> hits; // executions per program index
+        uint32_t stackDepth = 0; // bytes below the initial esp at the deepest point
+
+        void reset(){
+            data = text = decode = run = emit = 0;
+            hits.clear();
+            stackDepth = 0;
+        }
+    };
+
+    // What --stats reports for one file
+    struct Summary{
+        std::string file;
+        std::string error; // empty when the conversion finished
+        double data, text, decode, run, emit;
+        uint64_t executed;
+        std::vector<std::pair<std::string, uint64_t>> mnemonics; // most executed first
+        uint64_t bytesEmitted;
+        uint32_t stackDepth;
+        uint32_t memoryPeak; // bytes of .data
+    };
+
+    Summary summarize(const Machine& m, const std::string& file, const std::string& error);
+
+    void printHuman(const Summary& s, std::ostream& out);
+    // A JSON array of every summary, in order
+    void printJson(const std::vector<Summary>& summaries, std::ostream& out);
+}
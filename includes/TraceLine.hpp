@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace Trace{
+    enum Flags : uint8_t{
+        READS_MEMORY = 1,
+        BARRIER = 2, // observes and may change everything: call, int, lines copied verbatim
+        REMOVABLE = 4, // writing its registers (or its store) is the only thing the line does
+        STORE = 8 // writes size bytes at address
+    };
+}
+
+// One line of the trace: head + value + tail, or only tail for lines without a value
+struct TraceLine{
+    const void* source; // emitting instruction; lines from the same source and tail have the same shape
+    std::string_view head;
+    std::string_view tail;
+    int64_t value;
+    uint8_t size; // operand size of the value, 0 = no value
+    uint8_t flags; // Trace::Flags
+    uint32_t reads; // register lanes read, see Registers::lanes
+    uint32_t writes; // register lanes written
+    uint32_t address; // for STORE lines
+};
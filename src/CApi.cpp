@@ -0,0 +1,94 @@
+#include "MovFuscator.h"
+
+#include <new>
+
+#include "MovFuscator.hpp"
+
+struct movfuscator_converter{
+    explicit movfuscator_converter(const MovFuscator::Options& options) : converter(options){}
+
+    MovFuscator::Converter converter;
+    MovFuscator::Result result;
+};
+
+namespace{
+    class CallbackSink : public MovFuscator::Sink{
+    public:
+        CallbackSink(movfuscator_write callback, void* context) : callback(callback), context(context){}
+        void write(const char* data, size_t size) override{ if(callback) callback(context, data, size); }
+    private:
+        movfuscator_write callback;
+        void* context;
+    };
+}
+
+extern "C"{
+    void movfuscator_default_options(movfuscator_options* options){
+        MovFuscator::Options defaults;
+        *options = {
+            .memory_size = defaults.memorySize,
+            .reroll = defaults.reroll,
+            .dead_stores = defaults.deadStores,
+            .summarize_loops = defaults.summarizeLoops,
+            .jit = defaults.jit,
+            .max_instructions = defaults.limits.instructions,
+            .max_output = defaults.limits.outputBytes,
+            .time_limit = defaults.limits.seconds,
+            .threads = defaults.threads
+        };
+    }
+
+    movfuscator_converter* movfuscator_new(const movfuscator_options* options){
+        movfuscator_options given;
+        if(options) given = *options;
+        else movfuscator_default_options(&given);
+        if(given.memory_size < Mem::PAGE_SIZE || given.memory_size > Mem::MAX_SIZE || given.time_limit < 0)
+            return nullptr;
+
+        MovFuscator::Options converted = {
+            .memorySize = given.memory_size,
+            .reroll = given.reroll != 0,
+            .deadStores = given.dead_stores != 0,
+            .summarizeLoops = given.summarize_loops != 0,
+            .jit = given.jit != 0,
+            .limits = {
+                .instructions = given.max_instructions,
+                .seconds = given.time_limit,
+                .outputBytes = given.max_output
+            },
+            .threads = given.threads
+        };
+        try{
+            return new movfuscator_converter(converted);
+        }catch(const std::bad_alloc&){
+            return nullptr;
+        }
+    }
+
+    void movfuscator_free(movfuscator_converter* converter){
+        delete converter;
+    }
+
+    int movfuscator_convert(movfuscator_converter* converter, const char* source, size_t length,
+                            movfuscator_write write, void* context){
+        CallbackSink sink(write, context);
+        try{
+            converter->result = converter->converter.convert({source, length}, sink);
+        }catch(const std::exception& e){
+            converter->result = {.error = e.what()};
+        }
+        return converter->result.ok() ? 0 : -1;
+    }
+
+    const char* movfuscator_error(const movfuscator_converter* converter){
+        return converter->result.error.c_str();
+    }
+
+    const char* movfuscator_diagnostics(const movfuscator_converter* converter){
+        return converter->result.diagnostics.c_str();
+    }
+
+    uint64_t movfuscator_executed(const movfuscator_converter* converter){
+        return converter->result.executed;
+    }
+}
@@ -0,0 +1,252 @@
+#include "Cache.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Source.hpp"
+
+namespace fs = std::filesystem;
+
+namespace{
+    constexpr uint64_t P1 = 11400714785074694791ull;
+    constexpr uint64_t P2 = 14029467366897019727ull;
+    constexpr uint64_t P3 = 1609587929392839161ull;
+    constexpr uint64_t P4 = 9650029242287828579ull;
+    constexpr uint64_t P5 = 2870177450012600261ull;
+
+    constexpr std::string_view MAGIC = "MFC1"; // first word of an entry, changes with its layout
+    constexpr std::string_view TEMPORARY = ".tmp-"; // entries being written
+    constexpr auto ABANDONED = std::chrono::hours(1); // a temporary file this old lost its writer
+
+    uint64_t rotl(uint64_t x, int r){ return (x << r) | (x >> (64 - r)); }
+
+    uint64_t read64(const char* p){
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v; // little-endian hosts; elsewhere the hash differs but stays consistent
+    }
+
+    uint32_t read32(const char* p){
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint64_t round(uint64_t acc, uint64_t input){
+        return rotl(acc + input * P2, 31) * P1;
+    }
+
+    uint64_t merge(uint64_t acc, uint64_t value){
+        return (acc ^ round(0, value)) * P1 + P4;
+    }
+
+    // Identifies the converter itself: the executable it runs in, so any rebuild
+    // starts from an empty cache. Where that can't be read, the build time of this file.
+    uint64_t build(){
+        static const uint64_t id = []{
+            Source::Text self;
+            if(self.open("/proc/self/exe") && !self.view().empty()) return Cache::xxh64(self.view(), 0);
+            return Cache::xxh64(__DATE__ " " __TIME__, 0);
+        }();
+        return id;
+    }
+
+    bool isEntry(const std::string& name){
+        return name.size() == 32 && std::all_of(name.begin(), name.end(), [](char c){
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+        });
+    }
+}
+
+namespace Cache{
+    uint64_t xxh64(std::string_view data, uint64_t seed){
+        const char* p = data.data();
+        const char* end = p + data.size();
+        uint64_t h;
+        if(data.size() >= 32){
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            for(; p + 32 <= end; p += 32){
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+            }
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        }else{
+            h = seed + P5;
+        }
+        h += data.size();
+        for(; p + 8 <= end; p += 8)
+            h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+        if(p + 4 <= end){
+            h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for(; p < end; p++)
+            h = rotl(h ^ (static_cast<uint8_t>(*p) * P5), 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    std::string Key::hex() const{
+        char text[33];
+        for(int i = 0; i < 16; i++){
+            text[i] = "0123456789abcdef"[(high >> (60 - 4 * i)) & 0xF];
+            text[16 + i] = "0123456789abcdef"[(low >> (60 - 4 * i)) & 0xF];
+        }
+        return std::string(text, 32);
+    }
+
+    Store::Store(std::string dir, uint64_t maxBytes) : dir(std::move(dir)), maxBytes(maxBytes){
+        std::error_code error;
+        fs::create_directories(this->dir, error);
+    }
+
+    Key Store::key(std::string_view source, const MovFuscator::Options& options){
+        const Machine::Limits& limits = options.limits;
+        std::string prefix = std::string(MAGIC) + ' ' + std::to_string(build())
+            + " mem " + std::to_string(options.memorySize)
+            + " reroll " + std::to_string(options.reroll)
+            + " dead-stores " + std::to_string(options.deadStores)
+            + " summarize-loops " + std::to_string(options.summarizeLoops)
+            + " max-instructions " + std::to_string(limits.instructions)
+            + " max-output " + std::to_string(limits.outputBytes)
+            + " time-limit " + std::to_string(limits.seconds);
+        return {
+            .high = xxh64(source, xxh64(prefix, 0)),
+            .low = xxh64(source, xxh64(prefix, P1))
+        };
+    }
+
+    bool Store::cacheable(const MovFuscator::Result& result, const MovFuscator::Options& options){
+        return result.ok() || options.limits.seconds == 0;
+    }
+
+    bool Store::lookup(const Key& key, Entry& entry) const{
+        const std::string path = dir + '/' + key.hex();
+        Source::Text file;
+        if(!file.open(path)) return false;
+
+        // A damaged entry is a miss, and removed so the next store rebuilds it
+        auto damaged = [&]{
+            std::error_code error;
+            fs::remove(path, error);
+            return false;
+        };
+
+        // MFC1 <executed> <output> <diagnostics> <error>\n, then the three texts
+        std::string_view text = file.view();
+        size_t newline = text.find('\n');
+        if(newline == std::string_view::npos || text.substr(0, MAGIC.size() + 1) != std::string(MAGIC) + ' ') return damaged();
+        std::string_view head = text.substr(MAGIC.size() + 1, newline - MAGIC.size() - 1);
+        uint64_t numbers[4];
+        for(uint64_t& number : numbers){
+            auto [next, ec] = std::from_chars(head.data(), head.data() + head.size(), number);
+            if(ec != std::errc()) return damaged();
+            head.remove_prefix(static_cast<size_t>(next - head.data()));
+            if(!head.empty() && head[0] == ' ') head.remove_prefix(1);
+        }
+        text.remove_prefix(newline + 1);
+        // Each size against what is left of the body, so no sum can wrap around
+        if(!head.empty() || numbers[1] > text.size() || numbers[2] > text.size() - numbers[1]
+           || numbers[3] != text.size() - numbers[1] - numbers[2]) return damaged();
+
+        entry.executed = numbers[0];
+        entry.output.assign(text.substr(0, numbers[1]));
+        entry.diagnostics.assign(text.substr(numbers[1], numbers[2]));
+        entry.error.assign(text.substr(numbers[1] + numbers[2]));
+
+        // Recently used: the last to be evicted
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+        return true;
+    }
+
+    void Store::store(const Key& key, const Entry& entry){
+        if(entry.output.size() > maxEntry()) return;
+
+        // Written under a name nobody else uses, then renamed over the entry in one step
+        static std::atomic<uint64_t> counter{0};
+        thread_local std::mt19937_64 random(std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        const std::string temporary = dir + '/' + std::string(TEMPORARY) + std::to_string(random()) + '-' + std::to_string(counter++);
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out << MAGIC << ' ' << entry.executed << ' ' << entry.output.size() << ' ' << entry.diagnostics.size()
+                << ' ' << entry.error.size() << '\n' << entry.output << entry.diagnostics << entry.error;
+            if(!out.flush()){
+                out.close();
+                std::error_code error;
+                fs::remove(temporary, error);
+                return;
+            }
+        }
+        std::error_code error;
+        fs::rename(temporary, dir + '/' + key.hex(), error);
+        if(error){
+            fs::remove(temporary, error);
+            return;
+        }
+
+        // The directory is only scanned after a share of its size was written
+        uint64_t written = entry.output.size() + entry.diagnostics.size() + entry.error.size();
+        uint64_t before = sinceTrim.fetch_add(written);
+        if(before == UINT64_MAX || before + written >= maxBytes / 16){
+            sinceTrim = 0;
+            trim();
+        }
+    }
+
+    // Removes the least recently used entries until the directory is at 3/4 of its size,
+    // and temporary files their writer abandoned. Files other processes remove first are skipped.
+    void Store::trim(){
+        struct File{
+            fs::path path;
+            uint64_t size;
+            fs::file_time_type used;
+        };
+        std::vector<File> files;
+        uint64_t total = 0;
+        const auto now = fs::file_time_type::clock::now();
+        std::error_code error;
+        for(fs::directory_iterator it(dir, error), end; !error && it != end; it.increment(error)){
+            std::error_code fileError;
+            const std::string name = it->path().filename().string();
+            fs::file_time_type used = it->last_write_time(fileError);
+            if(fileError) continue;
+            if(name.compare(0, TEMPORARY.size(), TEMPORARY) == 0){
+                if(now - used > ABANDONED) fs::remove(it->path(), fileError);
+                continue;
+            }
+            if(!isEntry(name)) continue;
+            uint64_t size = it->file_size(fileError);
+            if(fileError) continue;
+            files.push_back({it->path(), size, used});
+            total += size;
+        }
+        if(total <= maxBytes) return;
+
+        std::sort(files.begin(), files.end(), [](const File& a, const File& b){ return a.used < b.used; });
+        for(const File& file : files){
+            if(total <= maxBytes / 4 * 3) break;
+            std::error_code fileError;
+            fs::remove(file.path, fileError);
+            total -= file.size;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include "Cfg.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "Machine.hpp"
+
+namespace Cfg{
+    static bool endsBlock(Instr::Type type){
+        using Instr::Type;
+        return type == Type::JMP || type == Type::JCC || type == Type::LOOP || type == Type::CALL || type == Type::RET;
+    }
+
+    // Reverse postorder from the roots, depth first
+    static void number(Graph& g){
+        std::vector<uint32_t> post;
+        std::vector<bool> seen(g.blocks.size(), false);
+        std::vector<std::pair<uint32_t, size_t>> stack; // block, next successor
+        for(uint32_t root : g.roots){
+            if(seen[root]) continue;
+            seen[root] = true;
+            stack.push_back({root, 0});
+            while(!stack.empty()){
+                auto& [b, next] = stack.back();
+                if(next < g.blocks[b].succs.size()){
+                    uint32_t s = g.blocks[b].succs[next++];
+                    if(!seen[s]){
+                        seen[s] = true;
+                        stack.push_back({s, 0});
+                    }
+                }else{
+                    post.push_back(b);
+                    stack.pop_back();
+                }
+            }
+        }
+        for(uint32_t i = 0; i < post.size(); i++)
+            g.blocks[post[post.size() - 1 - i]].order = i;
+    }
+
+    // Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm". The roots
+    // hang off a virtual root so functions entered only by call get a tree too.
+    static void dominators(Graph& g){
+        const uint32_t count = g.blocks.size(), virtualRoot = count;
+        std::vector<uint32_t> rpo(count + 1, NONE), idom(count + 1, NONE), order(count + 1, 0);
+        std::vector<bool> isRoot(count, false);
+        uint32_t reached = 0;
+        for(uint32_t b = 0; b < count; b++){
+            if(!g.reachable(b)) continue;
+            rpo[g.blocks[b].order] = b;
+            order[b] = g.blocks[b].order + 1;
+            reached++;
+        }
+        for(uint32_t root : g.roots) isRoot[root] = true;
+        idom[virtualRoot] = virtualRoot;
+
+        auto intersect = [&](uint32_t a, uint32_t b){
+            while(a != b){
+                while(order[a] > order[b]) a = idom[a];
+                while(order[b] > order[a]) b = idom[b];
+            }
+            return a;
+        };
+        for(bool changed = true; changed; ){
+            changed = false;
+            for(uint32_t i = 0; i < reached; i++){
+                uint32_t b = rpo[i];
+                uint32_t next = isRoot[b] ? virtualRoot : NONE;
+                for(uint32_t p : g.blocks[b].preds){
+                    if(idom[p] == NONE) continue; // not processed yet
+                    next = next == NONE ? p : intersect(p, next);
+                }
+                if(next != idom[b]){
+                    idom[b] = next;
+                    changed = true;
+                }
+            }
+        }
+        for(uint32_t b = 0; b < count; b++)
+            g.blocks[b].idom = idom[b] == virtualRoot ? NONE : idom[b];
+    }
+
+    bool Graph::dominates(uint32_t a, uint32_t b) const{
+        if(!reachable(b)) return false;
+        for(; b != NONE; b = blocks[b].idom)
+            if(b == a) return true;
+        return false;
+    }
+
+    Graph build(const Machine& m){
+        using Instr::Type;
+        const std::vector<Instr::Instruction>& program = m.program;
+        const uint32_t n = program.size();
+        Graph g;
+        g.blockOf.assign(n, NONE);
+        if(n == 0) return g;
+
+        std::vector<bool> leader(n, false);
+        leader[0] = true;
+        if(m.entry < n) leader[m.entry] = true;
+        for(uint32_t i = 0; i < n; i++){
+            if(program[i].type == Type::LABEL) leader[i] = true;
+            if(endsBlock(program[i].type) && i + 1 < n) leader[i + 1] = true;
+        }
+        for(uint32_t i = 0; i < n; i++){
+            if(leader[i]) g.blocks.push_back({.begin = i, .end = i});
+            g.blocks.back().end = i + 1;
+            g.blockOf[i] = g.blocks.size() - 1;
+        }
+
+        auto edge = [&](uint32_t from, uint32_t instruction){
+            if(instruction >= n) return;
+            uint32_t to = g.blockOf[instruction];
+            std::vector<uint32_t>& succs = g.blocks[from].succs;
+            if(std::find(succs.begin(), succs.end(), to) != succs.end()) return;
+            succs.push_back(to);
+            g.blocks[to].preds.push_back(from);
+        };
+        if(m.entry < n) g.roots.push_back(g.blockOf[m.entry]);
+        for(uint32_t b = 0; b < g.blocks.size(); b++){
+            Block& block = g.blocks[b];
+            const Instr::Instruction& last = program[block.end - 1];
+            if(last.type == Type::JMP || last.type == Type::JCC || last.type == Type::LOOP) edge(b, last.target);
+            if(last.type == Type::CALL && !last.external && last.target < n){
+                uint32_t callee = g.blockOf[last.target];
+                if(std::find(g.roots.begin(), g.roots.end(), callee) == g.roots.end()) g.roots.push_back(callee);
+            }
+            if(last.type != Type::JMP && last.type != Type::RET && block.end < n){
+                block.fallthrough = g.blockOf[block.end];
+                edge(b, block.end);
+            }
+        }
+
+        number(g);
+        dominators(g);
+        return g;
+    }
+
+    static std::string escape(std::string_view str){
+        std::string r;
+        for(char c : str){
+            if(c == '\n') continue;
+            if(c == '"' || c == '\\') r += '\\';
+            r += c;
+        }
+        return r;
+    }
+
+    void writeDot(const Graph& g, const Machine& m, const std::string& name, std::ostream& out,
+                  const std::vector<uint64_t>* hits){
+        out << "digraph \"" << escape(name) << "\" {\n"
+               "  node [shape=box, fontname=\"monospace\"];\n";
+        for(uint32_t b = 0; b < g.blocks.size(); b++){
+            const Block& block = g.blocks[b];
+            out << "  b" << b << " [label=\"b" << b;
+            if(hits && block.begin < hits->size()) out << "  ran " << (*hits)[block.begin];
+            if(block.idom != NONE) out << "  idom b" << block.idom;
+            out << "\\l";
+            for(uint32_t i = block.begin; i < block.end; i++)
+                out << escape(m.program[i].text->line) << "\\l";
+            out << '"';
+            if(!g.reachable(b)) out << ", color=gray, fontcolor=gray";
+            out << "];\n";
+        }
+        for(uint32_t b = 0; b < g.blocks.size(); b++){
+            const Block& block = g.blocks[b];
+            const Instr::Instruction& last = m.program[block.end - 1];
+            bool jumps = last.type == Instr::Type::JMP || last.type == Instr::Type::JCC || last.type == Instr::Type::LOOP;
+            for(uint32_t s : block.succs){
+                out << "  b" << b << " -> b" << s;
+                if(s == block.fallthrough && !(jumps && g.blockOf[last.target] == s)) out << " [style=dashed]";
+                out << ";\n";
+            }
+        }
+        out << "}\n";
+    }
+}
@@ -0,0 +1,128 @@
+#include "MovFuscator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <streambuf>
+
+#include "Decode.hpp"
+#include "Image.hpp"
+#include "Instr.hpp"
+#include "Loader.hpp"
+
+namespace{
+    // Lets the Emitter write to a Sink: each of its writes arrives as one block
+    class SinkBuffer : public std::streambuf{
+    public:
+        explicit SinkBuffer(MovFuscator::Sink& sink) : sink(sink){}
+
+        std::string* copy = nullptr; // also gets what is written, while set
+
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize size) override{
+            sink.write(data, static_cast<size_t>(size));
+            if(copy) copy->append(data, static_cast<size_t>(size));
+            return size;
+        }
+
+        int_type overflow(int_type c) override{
+            if(!traits_type::eq_int_type(c, traits_type::eof())){
+                char ch = traits_type::to_char_type(c);
+                sink.write(&ch, 1);
+                if(copy) *copy += ch;
+            }
+            return traits_type::not_eof(c);
+        }
+
+    private:
+        MovFuscator::Sink& sink;
+    };
+}
+
+namespace MovFuscator{
+    Converter::Converter(const Options& options) : m(options.memorySize){
+        m.reroll.enabled = options.reroll;
+        m.deadStores.enabled = options.deadStores;
+        m.loops.enabled = options.summarizeLoops;
+        m.jit.enabled = options.jit && Jit::supported();
+        m.limits = options.limits;
+        m.stats.enabled = options.stats;
+        m.out.timed = m.stats.enabled;
+        m.threads = std::max(1u, options.threads);
+    }
+
+    Result Converter::convert(std::string_view source, Sink& sink, Sink* image){
+        SinkBuffer buffer(sink);
+        std::ostream out(&buffer);
+        diagnostics.str({});
+        diagnostics.clear();
+
+        m.reset();
+        m.out.open(&out, m.limits.outputBytes ? m.limits.outputBytes : UINT64_MAX);
+        m.err = &diagnostics;
+
+        // Wall time of the current phase, without what it spent writing output (counted under emit)
+        using Clock = std::chrono::steady_clock;
+        Stats::Counters& stats = m.stats;
+        double* phase = nullptr;
+        Clock::time_point start;
+        double written = 0;
+        auto begin = [&](double& next){
+            phase = &next;
+            start = Clock::now();
+            written = m.out.writeSeconds();
+        };
+        auto lap = [&]{
+            if(phase) *phase += std::chrono::duration<double>(Clock::now() - start).count() - (m.out.writeSeconds() - written);
+            phase = nullptr;
+        };
+
+        // The output before the program runs goes into the image too
+        std::string prologue;
+        if(image) buffer.copy = &prologue;
+
+        Result result;
+        try{
+            if(Image::is(source)){
+                begin(stats.decode);
+                Image::load(m, source);
+            }else{
+                loadSource(m, source);
+                m.out << m.currentLabel << ":\n";
+                begin(stats.decode);
+                decodeProgram(m);
+            }
+            result.decoded = true;
+            lap();
+            if(image){
+                m.out.flush();
+                buffer.copy = nullptr;
+                if(!m.out.overflowed()){
+                    SinkBuffer imageBuffer(*image);
+                    std::ostream imageOut(&imageBuffer);
+                    Image::write(m, prologue, diagnostics.str(), imageOut);
+                }
+            }
+            begin(stats.run);
+            Instr::run(m, m.entry);
+            lap();
+        }catch(const std::exception& e){
+            lap();
+            result.error = e.what();
+        }
+        begin(stats.emit);
+        m.finishTrace();
+        m.out.close();
+        lap();
+        stats.emit += m.out.writeSeconds();
+        m.err = &std::cerr;
+
+        result.diagnostics = diagnostics.str();
+        result.executed = m.executed;
+        result.bytes = m.out.bytes();
+        return result;
+    }
+
+    Result convert(std::string_view source, Sink& out, const Options& options){
+        return Converter(options).convert(source, out);
+    }
+}
@@ -0,0 +1,80 @@
+#include "DeadStores.hpp"
+
+#include <algorithm>
+
+#include "Registers.hpp"
+
+void DeadStores::reset(){
+    queue.clear();
+    front = 0;
+    registers.clear();
+    stores.clear();
+    droppedLines = 0;
+}
+
+void DeadStores::push(const TraceLine& line){
+    const bool barrier = line.flags & Trace::BARRIER;
+    const uint32_t reads = barrier ? Registers::ALL_LANES : line.reads;
+    const bool readsMemory = barrier || (line.flags & Trace::READS_MEMORY);
+    auto undecided = [this](uint64_t id){ return !at(id).decided; };
+
+    // Values this line observes are kept, the ones it overwrites are dropped
+    for(uint64_t id : registers){
+        Entry& e = at(id);
+        if(e.unread & reads){
+            e.decided = true;
+        }else if(!(e.unread &= ~line.writes)){
+            e.decided = e.dead = true;
+        }
+    }
+    registers.erase(std::partition(registers.begin(), registers.end(), undecided), registers.end());
+
+    for(uint64_t id : stores){
+        Entry& e = at(id);
+        if(readsMemory){
+            e.decided = true;
+        }else if(line.flags & Trace::STORE && line.address <= e.line.address &&
+                 uint64_t(e.line.address) + e.line.size <= uint64_t(line.address) + line.size){
+            e.decided = e.dead = true;
+        }
+    }
+    stores.erase(std::partition(stores.begin(), stores.end(), undecided), stores.end());
+
+    const uint64_t id = front + queue.size();
+    const bool removable = line.flags & Trace::REMOVABLE;
+    queue.push_back({line, line.writes, true, false});
+    if(removable && (line.flags & Trace::STORE)){
+        queue.back().decided = false;
+        stores.push_back(id);
+        if(stores.size() > MAX_STORES){
+            at(stores.front()).decided = true;
+            stores.erase(stores.begin());
+        }
+    }else if(removable && line.writes){
+        queue.back().decided = false;
+        registers.push_back(id);
+    }
+
+    if(queue.size() > MAX_PENDING){
+        at(front).decided = true;
+        registers.erase(std::remove(registers.begin(), registers.end(), front), registers.end());
+        stores.erase(std::remove(stores.begin(), stores.end(), front), stores.end());
+    }
+    drain();
+}
+
+void DeadStores::finish(){
+    for(Entry& e : queue) e.decided = true;
+    registers.clear();
+    stores.clear();
+    drain();
+}
+
+void DeadStores::drain(){
+    while(!queue.empty() && queue.front().decided){
+        if(queue.front().dead) droppedLines++;
+        else next.push(queue.front().line);
+        queue.pop_front();
+        front++;
+    }
+}
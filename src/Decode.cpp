@@ -0,0 +1,386 @@
+#include "Decode.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+#include <stdexcept>
+#include <vector>
+
+#include "Lexer.hpp"
+#include "Mnemonics.hpp"
+#include "Parallel.hpp"
+
+// Below this many lines per thread a program is decoded on one thread
+static constexpr size_t MIN_RANGE = 1 << 14;
+
+Registers::Reg decodeRegister(std::string_view str){
+    auto it = Registers::stringToTag.find(str);
+    if(it == Registers::stringToTag.end())
+        throw std::runtime_error("Unknown register " + std::string(str));
+    return it->second;
+}
+
+std::string_view trim(std::string_view str){
+    return Lexer::trim(str);
+}
+
+// Names a label rather than a number
+static bool isSymbol(std::string_view str){
+    return !str.empty() && (std::isalpha(static_cast<unsigned char>(str[0])) || str[0] == '_' || str[0] == '.');
+}
+
+static int32_t parseNumber(std::string_view str, int base = 0){
+    uint32_t value;
+    if(!Lexer::number(str, value, base))
+        throw std::runtime_error("Bad number " + std::string(str));
+    return static_cast<int32_t>(value);
+}
+
+// .data label with an optional offset: "x", "v+8", "v-4"; false when str names no .data label
+static bool labelAddress(const Machine& m, std::string_view str, int32_t& address){
+    size_t sign = str.find_first_of("+-");
+    auto label = m.labels.find(trim(str.substr(0, sign)));
+    if(label == m.labels.end()) return false;
+    address = static_cast<int32_t>(label->second.address);
+    if(sign != std::string_view::npos) address += parseNumber(trim(str.substr(sign)));
+    return true;
+}
+
+Operands::OperandSpec decodeOperand(const Machine& m, std::string_view str){
+    if(str.empty())
+        throw std::runtime_error("Missing operand");
+
+    if(str[0] == '$'){
+        std::string_view l = str.substr(1);
+        auto label = m.labels.find(l);
+        if(label != m.labels.end()){
+            return {.type=Operands::OperandType::IMMEDIATE, .imm=static_cast<int32_t>(label->second.address), .isLabel=true};
+        }else if(isSymbol(l)){
+            throw std::runtime_error("undefined label " + std::string(l));
+        }else{
+            // Handle binary literals with 0b prefix
+            int32_t value;
+            if(l.length() > 2 && l[0] == '0' && (l[1] == 'b' || l[1] == 'B')){
+                value = parseNumber(l.substr(2), 2);
+            } else {
+                value = parseNumber(l);
+            }
+            return {.type=Operands::OperandType::IMMEDIATE, .imm=value};
+        }
+    }else if(str[0] == '%'){
+        return {.type=Operands::OperandType::REGISTER, .regTag=decodeRegister(str)};
+    }else if(str.find('(') != std::string_view::npos){
+        // disp(base, index, scale), every part is optional
+        size_t openPos = str.find('(');
+        size_t closePos = str.find(')');
+        if(closePos == std::string_view::npos || closePos < openPos)
+            throw std::runtime_error("Bad memory operand " + std::string(str));
+        std::string_view dispStr = trim(str.substr(0, openPos));
+        std::string_view innerStr = str.substr(openPos + 1, closePos - openPos - 1);
+
+        Operands::OperandSpec spec = {.type=Operands::OperandType::ADDRESS, .imm=0};
+        if(!dispStr.empty() && !labelAddress(m, dispStr, spec.imm)){
+            if(isSymbol(dispStr))
+                throw std::runtime_error("undefined label " + std::string(dispStr));
+            spec.imm = parseNumber(dispStr);
+        }
+
+        // base, index, scale: split at the commas, in place
+        std::string_view parts[3];
+        size_t count = 0;
+        while(count < 3 && !innerStr.empty()){
+            size_t comma = innerStr.find(',');
+            parts[count++] = trim(innerStr.substr(0, comma));
+            innerStr.remove_prefix(comma == std::string_view::npos ? innerStr.size() : comma + 1);
+        }
+
+        if(!parts[0].empty())
+            spec.base = decodeRegister(parts[0]);
+        if(!parts[1].empty())
+            spec.index = decodeRegister(parts[1]);
+        if(!parts[2].empty())
+            spec.scale = static_cast<uint8_t>(parseNumber(parts[2]));
+        return spec;
+    }else{
+        // Labels that are not in .data (stdout...) read from address 0
+        int32_t address = 0;
+        labelAddress(m, str, address);
+        return {.type=Operands::OperandType::ADDRESS, .imm=address};
+    }
+}
+
+// Register lanes an operand reads: the register itself, or the registers of its address
+static uint32_t operandLanes(const Operands::OperandSpec& op){
+    if(op.type == Operands::OperandType::REGISTER) return Registers::lanes(op.regTag);
+    if(op.type == Operands::OperandType::ADDRESS) return Registers::lanes(op.base) | Registers::lanes(op.index);
+    return 0;
+}
+
+// Lanes written when op is the destination, 0 for memory
+static uint32_t destLanes(const Operands::OperandSpec& op){
+    return op.type == Operands::OperandType::REGISTER ? Registers::lanes(op.regTag) : 0;
+}
+
+// Lanes read when op is the destination: only the registers of a memory address
+static uint32_t addressLanes(const Operands::OperandSpec& op){
+    return op.type == Operands::OperandType::ADDRESS ? operandLanes(op) : 0;
+}
+
+// Pre-renders the parts of the output line that don't depend on the simulated values,
+// and records what that line does (mirrors the choice each handler makes)
+static void renderText(const Instr::Instruction& ins, std::string_view name, Instr::Text& text,
+                       std::string& written, std::string& tail){
+    using Operands::OperandType;
+    const char suffix = ins.size == 4 ? 'l' : ins.size == 2 ? 'w' : 'b';
+    const bool memSrc = ins.src.type == OperandType::ADDRESS;
+    const bool memDest = ins.dest.type == OperandType::ADDRESS;
+    const std::string src(text.src), dest(text.dest);
+
+    // movX $value, dest
+    auto valueLine = [&](const Operands::OperandSpec& to){
+        tail = ", " + (&to == &ins.src ? src : dest) + '\n';
+        text.reads = addressLanes(to);
+        text.writes = destLanes(to);
+        text.traceFlags = Trace::REMOVABLE;
+        if(to.type == OperandType::ADDRESS) text.traceFlags |= Trace::STORE;
+    };
+
+    switch(ins.type){
+        case Instr::Type::MOV:
+        case Instr::Type::SUB:
+        case Instr::Type::AND:
+        case Instr::Type::OR:
+        case Instr::Type::XOR:
+        case Instr::Type::SHL:
+        case Instr::Type::SHR:
+        case Instr::Type::SAR:
+            written = std::string(name) + suffix + ' ' + src + ", " + dest + '\n';
+            if(ins.type == Instr::Type::MOV && (memSrc || memDest || ins.src.isLabel)){
+                // movl x, %eax / movl %eax, x / movl $label, %eax
+                text.reads = operandLanes(ins.src) | addressLanes(ins.dest);
+                text.writes = destLanes(ins.dest);
+                text.traceFlags = memSrc ? Trace::READS_MEMORY : 0;
+                if(!memDest) text.traceFlags |= Trace::REMOVABLE;
+            }else if(ins.type != Instr::Type::MOV && memDest){
+                // subl %eax, x
+                text.reads = operandLanes(ins.src) | addressLanes(ins.dest);
+                text.traceFlags = Trace::READS_MEMORY;
+            }else{
+                valueLine(ins.dest);
+            }
+            break;
+        case Instr::Type::ADD:
+        case Instr::Type::ADC:
+        case Instr::Type::SBB: // the output has no carry to subtract: always a value
+            valueLine(ins.dest);
+            break;
+        case Instr::Type::INC:
+        case Instr::Type::DEC:
+        case Instr::Type::SETCC:
+            valueLine(ins.src);
+            break;
+        case Instr::Type::CMOVCC:
+            if(memSrc){
+                // cmovel x, %eax that moves: movl x, %eax
+                written = std::string("mov") + suffix + ' ' + src + ", " + dest + '\n';
+                text.reads = operandLanes(ins.src);
+                text.writes = destLanes(ins.dest);
+                text.traceFlags = Trace::READS_MEMORY | Trace::REMOVABLE;
+            }else{
+                valueLine(ins.dest);
+            }
+            break;
+        case Instr::Type::LEA:
+            written = std::string("mov") + suffix + " $" + src + ", " + dest + '\n';
+            text.reads = addressLanes(ins.src) | addressLanes(ins.dest);
+            text.writes = destLanes(ins.dest);
+            if(text.writes) text.traceFlags = Trace::REMOVABLE;
+            break;
+        case Instr::Type::PUSH:
+        case Instr::Type::POP:{
+            written = std::string(name) + suffix + ' ' + src + '\n';
+            const uint32_t esp = Registers::lanes(Registers::ESP);
+            if(ins.type == Instr::Type::PUSH){
+                text.reads = operandLanes(ins.src) | esp;
+                text.writes = esp;
+                text.traceFlags = memSrc ? Trace::READS_MEMORY : 0;
+            }else{
+                text.reads = addressLanes(ins.src) | esp;
+                text.writes = destLanes(ins.src) | esp;
+                text.traceFlags = Trace::READS_MEMORY;
+            }
+            break;
+        }
+        case Instr::Type::CALL:
+            written = "call " + src + '\n';
+            text.traceFlags = Trace::BARRIER;
+            break;
+        default:
+            text.traceFlags = Trace::BARRIER;
+            break;
+    }
+}
+
+// Copies the line and its rendered parts into text.storage and points the views there.
+// mnemonic, src and dest still point into line when this is called.
+static void keep(Instr::Text& text, std::string_view line, std::string_view written = {}, std::string_view tail = {}){
+    std::string& s = text.storage;
+    // Always on the heap, so moving the Text keeps the views valid
+    s.reserve(std::max<size_t>(line.size() + 1 + written.size() + tail.size(), 16));
+    s.assign(line);
+    s += '\n';
+    s.append(written);
+    s.append(tail);
+    auto moved = [&](std::string_view part){
+        return part.empty() ? std::string_view{} : std::string_view(s).substr(static_cast<size_t>(part.data() - line.data()), part.size());
+    };
+    text.mnemonic = moved(text.mnemonic);
+    text.src = moved(text.src);
+    text.dest = moved(text.dest);
+    text.line = std::string_view(s).substr(0, line.size() + 1);
+    text.written = std::string_view(s).substr(line.size() + 1, written.size());
+    text.tail = std::string_view(s).substr(line.size() + 1 + written.size());
+}
+
+Instr::Instruction decodeLine(const Machine& m, std::string_view line, Instr::Text& text){
+    Instr::Instruction ins = {};
+    ins.text = &text;
+    const std::string_view whole = line;
+
+    // If line contains %esp, output it as-is
+    if(line.find("%esp") != std::string_view::npos){
+        ins.type = Instr::Type::VERBATIM;
+        text.traceFlags = Trace::BARRIER;
+        ins.handler = Instr::handlerId(ins.type, Operands::OperandType::NONE, Operands::OperandType::NONE);
+        keep(text, whole);
+        return ins;
+    }
+
+    if(!line.empty() && line.back()=='\n') line.remove_suffix(1);
+    if(!line.empty() && line.back()==':'){
+        ins.type = Instr::Type::LABEL;
+        ins.handler = Instr::handlerId(ins.type, Operands::OperandType::NONE, Operands::OperandType::NONE);
+        keep(text, whole);
+        return ins;
+    }
+
+    std::string_view operandsStr = line;
+    std::string_view instruction = Lexer::word(operandsStr);
+    text.mnemonic = instruction;
+
+    // Remove leading spaces
+    operandsStr = operandsStr.substr(std::min(operandsStr.find_first_not_of(" \t"), operandsStr.size()));
+
+    // Find the comma that separates operands (not inside parentheses)
+    size_t lastComma = std::string_view::npos;
+    int parenDepth = 0;
+    for(size_t i = operandsStr.length(); i-- > 0; ){
+        if(operandsStr[i] == ')') parenDepth++;
+        else if(operandsStr[i] == '(') parenDepth--;
+        else if(operandsStr[i] == ',' && parenDepth == 0){
+            lastComma = i;
+            break;
+        }
+    }
+
+    std::string_view src, dest;
+    if(lastComma != std::string_view::npos){
+        src = operandsStr.substr(0, lastComma);
+        dest = operandsStr.substr(lastComma + 1);
+    } else {
+        // Single operand instruction or two operands without comma
+        size_t spacePos = operandsStr.find_first_of(" \t");
+        if(spacePos != std::string_view::npos){
+            src = operandsStr.substr(0, spacePos);
+            dest = operandsStr.substr(spacePos);
+        } else {
+            src = operandsStr;
+        }
+    }
+
+    text.src = trim(src);
+    text.dest = trim(dest);
+
+    const Mnemonics::Entry* entry = Mnemonics::lookup(instruction, ins.size);
+    ins.type = entry ? entry->type : Instr::Type::UNKNOWN;
+    ins.handler = Instr::handlerId(ins.type, Operands::OperandType::NONE, Operands::OperandType::NONE);
+    if(!entry){
+        keep(text, whole);
+        return ins;
+    }
+    ins.cond = entry->cond;
+    if(ins.type == Instr::Type::SETCC) ins.size = 1;
+
+    switch(entry->form){
+        case Mnemonics::Form::TWO:
+            ins.src = decodeOperand(m, text.src);
+            ins.dest = decodeOperand(m, text.dest);
+            break;
+        case Mnemonics::Form::ONE:
+            ins.src = decodeOperand(m, text.src);
+            break;
+        case Mnemonics::Form::TARGET:{
+            auto label = m.instr_labels.find(text.src);
+            ins.external = (label == m.instr_labels.end());
+            ins.target = ins.external ? 0 : label->second;
+            // Only calls may leave the file (printf, fflush...)
+            if(ins.external && ins.type != Instr::Type::CALL)
+                throw std::runtime_error("undefined label " + std::string(text.src));
+            break;
+        }
+        case Mnemonics::Form::NONE:
+        case Mnemonics::Form::VERBATIM:
+            break;
+    }
+    // cmovl %ax, %bx: the register gives the size
+    if(ins.type == Instr::Type::CMOVCC && ins.dest.type == Operands::OperandType::REGISTER)
+        ins.size = Registers::regData[ins.dest.regTag].size / 8;
+    ins.handler = Instr::handlerId(ins.type, ins.src.type, ins.dest.type);
+    std::string written, tail;
+    renderText(ins, entry->name, text, written, tail);
+    keep(text, whole, written, tail);
+    return ins;
+}
+void decodeProgram(Machine& m){
+    const size_t n = m.instructions.size();
+    m.texts.resize(n);
+    m.program.resize(n);
+    // Every bad line is reported, not only the first one. Lines decode independently,
+    // so a large program is split into ranges, one per thread, and the reports joined in order.
+    const size_t ranges = std::max<size_t>(1, std::min<size_t>(m.threads, n / MIN_RANGE));
+    std::vector<std::string> rangeErrors(ranges);
+    std::vector<size_t> rangeCounts(ranges);
+    parallel(static_cast<unsigned>(ranges), [&](unsigned r){
+        for(size_t i = n * r / ranges; i < n * (r + 1) / ranges; i++){
+            try{
+                m.program[i] = decodeLine(m, m.instructions[i], m.texts[i]);
+            }catch(const std::exception& e){
+                rangeErrors[r] += "\n  " + std::string(m.instructions[i]) + ": " + e.what();
+                rangeCounts[r]++;
+            }
+        }
+    });
+    std::string errors;
+    size_t count = 0;
+    for(size_t r = 0; r < ranges; r++){
+        errors += rangeErrors[r];
+        count += rangeCounts[r];
+    }
+
+    if(m.currentLabel.empty()){
+        m.entry = 0; // no .global: from the first line
+    }else{
+        auto entry = m.instr_labels.find(m.currentLabel);
+        if(entry != m.instr_labels.end()) m.entry = entry->second;
+        else{
+            const std::string name(m.currentLabel);
+            errors += "\n  .global " + name + ": undefined label " + name;
+            count++;
+        }
+    }
+
+    if(count){
+        m.program.clear();
+        throw std::runtime_error(std::to_string(count) + (count == 1 ? " error" : " errors") + " in .text:" + errors);
+    }
+}
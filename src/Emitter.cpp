@@ -0,0 +1,18 @@
+#include "Emitter.hpp"
+
+void Emitter::flush(){
+    if(used == 0) return;
+    write(buffer.get(), used);
+    used = 0;
+}
+
+void Emitter::write(const char* data, size_t size){
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = timed ? Clock::now() : Clock::time_point{};
+    uint64_t room = total < limit ? limit - total : 0;
+    total += size;
+    if(size > room) size = static_cast<size_t>(room);
+    // Large blocks bypass the stream's own buffer, so this is one write to the file
+    if(sink && size) sink->write(data, static_cast<std::streamsize>(size));
+    if(timed) seconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
@@ -0,0 +1,317 @@
+#include "Image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace{
+    static_assert(std::is_trivially_copyable_v<Instr::Instruction>, "instructions are stored as they are in memory");
+
+    constexpr uint32_t ORDER_MARK = 0x01020304;
+
+    // A string in the strings section
+    struct Span{
+        uint32_t offset, length;
+    };
+
+    struct Header{
+        char magic[8];
+        uint32_t order; // ORDER_MARK, as the writer stores it
+        uint16_t instructionSize; // sizeof(Instr::Instruction)
+        uint16_t handlers; // Instr::HANDLER_COUNT
+        uint32_t registers; // Registers::COUNT
+        uint32_t count; // instructions
+        uint32_t entry;
+        uint32_t memoryPeak;
+        uint32_t dataSize; // .data bytes from address 0 to the last one that isn't 0
+        uint32_t dataLabels, codeLabels;
+        Span currentLabel, prologue, diagnostics;
+        uint32_t unused;
+        uint64_t program, texts, labels, data, strings, stringsSize; // where each section starts
+    };
+
+    // A part of the line: mnemonic, src and dest are always cut from it
+    struct Part{
+        uint16_t offset, length;
+    };
+
+    struct StoredText{
+        Span line, written, tail;
+        Part mnemonic, src, dest;
+        uint32_t reads, writes;
+        uint8_t traceFlags;
+        uint8_t unused[3];
+    };
+
+    // A .data label (value: address, with its element size) or a .text label (value: instruction index)
+    struct StoredLabel{
+        Span name;
+        uint32_t value;
+        uint8_t size;
+        uint8_t unused[3];
+    };
+
+    [[noreturn]] void tooLarge(){
+        throw std::runtime_error("Program too large for an image");
+    }
+
+    // The strings section while it is written
+    class Strings{
+    public:
+        Span add(std::string_view str){
+            if(text.size() + str.size() > UINT32_MAX) tooLarge();
+            Span span = {static_cast<uint32_t>(text.size()), static_cast<uint32_t>(str.size())};
+            text.append(str);
+            return span;
+        }
+
+        // Strings that repeat a lot (", %eax\n"), stored once. str has to outlive this.
+        Span shared(std::string_view str){
+            auto [it, added] = seen.try_emplace(str);
+            if(added) it->second = add(str);
+            return it->second;
+        }
+
+        std::string text;
+
+    private:
+        std::unordered_map<std::string_view, Span> seen;
+    };
+
+    Part within(std::string_view line, std::string_view part){
+        size_t at = part.empty() ? 0 : line.find(part);
+        if(at == std::string_view::npos) return {0, 0};
+        return {static_cast<uint16_t>(at), static_cast<uint16_t>(part.size())};
+    }
+
+    // Sections start 8-aligned
+    uint64_t aligned(uint64_t offset){
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    void pad(std::ostream& out, uint64_t& offset){
+        static const char zeros[8] = {};
+        uint64_t next = aligned(offset);
+        out.write(zeros, static_cast<std::streamsize>(next - offset));
+        offset = next;
+    }
+
+    void check(bool ok, const char* what){
+        if(!ok) throw std::runtime_error(std::string("Bad program image: ") + what);
+    }
+
+    template<typename T>
+    T record(std::string_view image, uint64_t offset){
+        T value;
+        std::memcpy(&value, image.data() + offset, sizeof(T));
+        return value;
+    }
+
+    // A field as the bytes the image had: registers and bools are only read once they are known to be valid
+    std::underlying_type_t<Registers::Reg> raw(const Registers::Reg& reg){
+        std::underlying_type_t<Registers::Reg> value;
+        std::memcpy(&value, &reg, sizeof(value));
+        return value;
+    }
+
+    uint8_t raw(const bool& flag){
+        static_assert(sizeof(bool) == 1);
+        uint8_t value;
+        std::memcpy(&value, &flag, 1);
+        return value;
+    }
+
+    bool operand(const Operands::OperandSpec& spec){
+        using Operands::OperandType;
+        return spec.type <= OperandType::NONE
+            && (spec.type != OperandType::REGISTER || raw(spec.regTag) < Registers::COUNT)
+            && raw(spec.base) <= Registers::COUNT
+            && raw(spec.index) <= Registers::COUNT
+            && raw(spec.isLabel) <= 1;
+    }
+
+    bool jumps(Instr::Type type){
+        return type == Instr::Type::JCC || type == Instr::Type::JMP || type == Instr::Type::LOOP || type == Instr::Type::CALL;
+    }
+}
+
+namespace Image{
+    bool is(std::string_view text){
+        return text.substr(0, MAGIC.size()) == MAGIC;
+    }
+
+    void write(const Machine& m, std::string_view prologue, std::string_view diagnostics, std::ostream& out){
+        const size_t count = m.program.size();
+        if(count > UINT32_MAX) tooLarge();
+        Strings strings;
+
+        std::vector<StoredText> texts(count);
+        for(size_t i = 0; i < count; i++){
+            const Instr::Text& text = *m.program[i].text;
+            StoredText& stored = texts[i];
+            std::memset(&stored, 0, sizeof(stored));
+            if(text.line.size() > UINT16_MAX) tooLarge();
+            stored.line = strings.add(text.line);
+            stored.written = strings.shared(text.written);
+            stored.tail = strings.shared(text.tail);
+            stored.mnemonic = within(text.line, text.mnemonic);
+            stored.src = within(text.line, text.src);
+            stored.dest = within(text.line, text.dest);
+            stored.reads = text.reads;
+            stored.writes = text.writes;
+            stored.traceFlags = text.traceFlags;
+        }
+
+        std::vector<StoredLabel> labels;
+        labels.reserve(m.labels.size() + m.instr_labels.size());
+        auto label = [&](std::string_view name, uint32_t value, uint8_t size){
+            StoredLabel& stored = labels.emplace_back();
+            std::memset(&stored, 0, sizeof(stored));
+            stored.name = strings.add(name);
+            stored.value = value;
+            stored.size = size;
+        };
+        for(const auto& [name, data] : m.labels) label(name, data.address, data.size);
+        for(const auto& [name, index] : m.instr_labels) label(name, index, 0);
+
+        // .data as laid out: memory is still untouched by the program
+        const uint32_t limit = static_cast<uint32_t>(std::min<uint64_t>(m.memoryPeak, m.memory.size()));
+        uint32_t dataSize = 0;
+        for(uint32_t page = limit ? ((limit - 1) >> Mem::PAGE_BITS) + 1 : 0; page-- > 0 && !dataSize; ){
+            const uint8_t* bytes = m.memory.pages()[page];
+            if(bytes == Mem::PagedMemory::zero()) continue;
+            uint32_t first = page << Mem::PAGE_BITS;
+            for(uint32_t end = std::min(limit, first + Mem::PAGE_SIZE); end > first; end--)
+                if(bytes[end - 1 - first]){
+                    dataSize = end;
+                    break;
+                }
+        }
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC.data(), sizeof(header.magic));
+        header.order = ORDER_MARK;
+        header.instructionSize = sizeof(Instr::Instruction);
+        header.handlers = Instr::HANDLER_COUNT;
+        header.registers = Registers::COUNT;
+        header.count = static_cast<uint32_t>(count);
+        header.entry = m.entry;
+        header.memoryPeak = m.memoryPeak;
+        header.dataSize = dataSize;
+        header.dataLabels = static_cast<uint32_t>(m.labels.size());
+        header.codeLabels = static_cast<uint32_t>(m.instr_labels.size());
+        header.currentLabel = strings.add(m.currentLabel);
+        header.prologue = strings.add(prologue);
+        header.diagnostics = strings.add(diagnostics);
+        header.program = aligned(sizeof(Header));
+        header.texts = aligned(header.program + count * sizeof(Instr::Instruction));
+        header.labels = aligned(header.texts + count * sizeof(StoredText));
+        header.data = aligned(header.labels + labels.size() * sizeof(StoredLabel));
+        header.strings = aligned(header.data + dataSize);
+        header.stringsSize = strings.text.size();
+
+        uint64_t offset = sizeof(Header);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        pad(out, offset);
+        // The text pointers mean nothing in another process: texts[i] belongs to program[i]
+        for(const Instr::Instruction& in : m.program){
+            Instr::Instruction stored = in;
+            stored.text = nullptr;
+            out.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+        }
+        offset += count * sizeof(Instr::Instruction);
+        pad(out, offset);
+        out.write(reinterpret_cast<const char*>(texts.data()), static_cast<std::streamsize>(count * sizeof(StoredText)));
+        offset += count * sizeof(StoredText);
+        pad(out, offset);
+        out.write(reinterpret_cast<const char*>(labels.data()), static_cast<std::streamsize>(labels.size() * sizeof(StoredLabel)));
+        offset += labels.size() * sizeof(StoredLabel);
+        pad(out, offset);
+        for(uint32_t address = 0; address < dataSize; ){
+            uint32_t part = std::min(dataSize - address, Mem::PAGE_SIZE - (address & (Mem::PAGE_SIZE - 1)));
+            out.write(reinterpret_cast<const char*>(m.memory.pages()[address >> Mem::PAGE_BITS] + (address & (Mem::PAGE_SIZE - 1))), part);
+            address += part;
+        }
+        offset += dataSize;
+        pad(out, offset);
+        out.write(strings.text.data(), static_cast<std::streamsize>(strings.text.size()));
+    }
+
+    void load(Machine& m, std::string_view image){
+        check(image.size() >= sizeof(Header) && is(image), "too short");
+        const Header header = record<Header>(image, 0);
+        if(header.order != ORDER_MARK || header.instructionSize != sizeof(Instr::Instruction)
+           || header.handlers != Instr::HANDLER_COUNT || header.registers != Registers::COUNT)
+            throw std::runtime_error("Program image from another build of the converter");
+
+        const uint64_t count = header.count;
+        const uint64_t labelCount = uint64_t(header.dataLabels) + header.codeLabels;
+        auto fits = [&](uint64_t offset, uint64_t size){ return offset <= image.size() && size <= image.size() - offset; };
+        check(fits(header.program, count * sizeof(Instr::Instruction)) && fits(header.texts, count * sizeof(StoredText))
+              && fits(header.labels, labelCount * sizeof(StoredLabel)) && fits(header.data, header.dataSize)
+              && fits(header.strings, header.stringsSize), "section out of range");
+        const std::string_view strings = image.substr(header.strings, header.stringsSize);
+        auto text = [&](Span span){
+            check(uint64_t(span.offset) + span.length <= strings.size(), "string out of range");
+            return strings.substr(span.offset, span.length);
+        };
+        check(header.entry <= count, "entry out of range");
+
+        if(header.dataSize > m.memory.size())
+            throw std::runtime_error("Program image needs --mem-size of at least " + std::to_string(header.dataSize));
+        m.memory.write(0, reinterpret_cast<const uint8_t*>(image.data() + header.data), header.dataSize);
+        m.memoryPeak = header.memoryPeak;
+        m.entry = header.entry;
+        m.currentLabel = text(header.currentLabel);
+
+        m.labels.reserve(header.dataLabels);
+        m.instr_labels.reserve(header.codeLabels);
+        for(uint64_t i = 0; i < labelCount; i++){
+            const StoredLabel label = record<StoredLabel>(image, header.labels + i * sizeof(StoredLabel));
+            if(i < header.dataLabels) m.labels[text(label.name)] = {label.size, label.value};
+            else m.instr_labels[text(label.name)] = label.value;
+        }
+
+        m.texts.resize(count);
+        m.program.resize(count);
+        std::memcpy(m.program.data(), image.data() + header.program, count * sizeof(Instr::Instruction));
+        // Handlers index a table and targets the program: neither may point outside.
+        // A damaged image leaves no program behind, like a source that doesn't decode.
+        try{
+            for(uint64_t i = 0; i < count; i++){
+                Instr::Instruction& in = m.program[i];
+                check(in.type <= Instr::Type::RET && in.size <= 4 && in.cond <= Flags::Cond::NONE && operand(in.src)
+                      && operand(in.dest) && in.handler == Instr::handlerId(in.type, in.src.type, in.dest.type), "bad instruction");
+                check(raw(in.external) <= 1 && (!jumps(in.type) || in.external || in.target < count), "jump out of the program");
+
+                const StoredText stored = record<StoredText>(image, header.texts + i * sizeof(StoredText));
+                Instr::Text& t = m.texts[i];
+                t.line = text(stored.line);
+                auto part = [&](Part p){
+                    check(uint32_t(p.offset) + p.length <= t.line.size(), "string out of range");
+                    return t.line.substr(p.offset, p.length);
+                };
+                t.mnemonic = part(stored.mnemonic);
+                t.src = part(stored.src);
+                t.dest = part(stored.dest);
+                t.written = text(stored.written);
+                t.tail = text(stored.tail);
+                t.reads = stored.reads;
+                t.writes = stored.writes;
+                t.traceFlags = stored.traceFlags;
+                in.text = &t;
+            }
+        }catch(const std::exception&){
+            m.program.clear();
+            throw;
+        }
+
+        m.out << text(header.prologue);
+        *m.err << text(header.diagnostics);
+    }
+}
@@ -0,0 +1,992 @@
+#include "Instr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "Cfg.hpp"
+#include "Operands.hpp"
+
+// Direct-threaded dispatch needs labels as values (GCC/Clang), the switch works everywhere
+#ifndef THREADED_DISPATCH
+    #if defined(__GNUC__)
+        #define THREADED_DISPATCH 1
+    #else
+        #define THREADED_DISPATCH 0
+    #endif
+#endif
+
+namespace Instr{
+    inline void emitLine(Machine& m, const Instruction& in, std::string_view head, int64_t value,
+                         std::string_view tail, uint32_t reads, uint32_t writes, uint8_t flags, uint32_t address){
+        if(m.tracing()){
+            m.trace({&in, head, tail, value, in.size, flags, reads, writes, address});
+            return;
+        }
+        m.out.put(head);
+        m.out.putInt(value);
+        m.out.put(tail);
+    }
+
+    // movX $value, dest; address is where it stores when dest is memory
+    inline void emitValue(Machine& m, const Instruction& in, int64_t value, uint32_t address){
+        emitLine(m, in, in.size == 4 ? "movl $" : in.size == 2 ? "movw $" : "movb $", value, in.text->tail,
+                 in.text->reads, in.text->writes, in.text->traceFlags, address);
+    }
+
+    // mul/div results, always into the same registers
+    inline void emitFixed(Machine& m, const Instruction& in, std::string_view head, int64_t value,
+                          std::string_view tail, Registers::Reg dest){
+        emitLine(m, in, head, value, tail, 0, Registers::lanes(dest), Trace::REMOVABLE, 0);
+    }
+
+    // Lines kept as written: "subl %eax, x", "pushl %ebx", "call printf", "int $0x80"...
+    inline void emitText(Machine& m, const Instruction& in, std::string_view text){
+        if(m.tracing()){
+            m.trace({&in, {}, text, 0, 0, in.text->traceFlags, in.text->reads, in.text->writes, 0});
+            return;
+        }
+        m.out.put(text);
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void add(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        int32_t val_s, val_d;
+
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+
+        val_s = Operands::readOperand<S>(m, op_s);
+        val_d = Operands::readOperand<D>(m, op_d);
+
+        int32_t sum = val_s + val_d;
+        Operands::writeOperand<D>(m, op_d, sum);
+        m.flags.set(Flags::Op::ADD, size, val_d, val_s, sum);
+        
+        emitValue(m, in, sum, op_d.address);
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void sub(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        int32_t val_s, val_d;
+
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+
+        val_s = Operands::readOperand<S>(m, op_s);
+        val_d = Operands::readOperand<D>(m, op_d);
+
+        int32_t sub = val_d - val_s;
+        Operands::writeOperand<D>(m, op_d, sub);
+        m.flags.set(Flags::Op::SUB, size, val_d, val_s, sub);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, sub, op_d.address);
+        }
+    }
+    template<Operands::OperandType S>
+    void div(Machine& m, const Instruction& in){
+        Operands::Operand op_s, eax, edx;
+        int32_t val_s;
+        int64_t edx_eax;
+        m.flags.clear(); // undefined after div
+
+        op_s = Operands::resolve<S>(m, in.src, 4);
+        val_s = Operands::readOperand<S>(m, op_s);
+        
+        edx = {
+            .type=Operands::OperandType::REGISTER,
+            .regTag=Registers::EDX
+        };
+        eax = {
+            .type=Operands::OperandType::REGISTER,
+            .regTag=Registers::EAX
+        };
+
+        edx_eax = ((uint64_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, edx)<<32) | (uint32_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, eax);
+        uint32_t rest, cat;
+        cat = (uint32_t)(edx_eax / val_s);
+        rest = (uint32_t)(edx_eax % val_s);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, eax, cat);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, edx, rest);
+        
+        emitFixed(m, in, "movl $", cat, ", %eax\n", Registers::EAX);
+        emitFixed(m, in, "movl $", rest, ", %edx\n", Registers::EDX);
+    }
+
+    template<Operands::OperandType S>
+    void mul(Machine& m, const Instruction& in){
+        Operands::Operand op_s, eax, edx;
+        int32_t val_s;
+        int64_t result;
+
+        op_s = Operands::resolve<S>(m, in.src, 4);
+        val_s = Operands::readOperand<S>(m, op_s);
+        
+        edx = {
+            .type=Operands::OperandType::REGISTER,
+            .regTag=Registers::EDX
+        };
+        eax = {
+            .type=Operands::OperandType::REGISTER,
+            .regTag=Registers::EAX
+        };
+
+        int32_t eax_val = Operands::readOperand<Operands::OperandType::REGISTER>(m, eax);
+        result = (int64_t)eax_val * val_s;
+        
+        uint32_t high = (uint32_t)(result >> 32);
+        uint32_t low = (uint32_t)result;
+        
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, eax, low);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, edx, high);
+        m.flags.set(Flags::Op::MUL, 4, eax_val, val_s, low, high != 0);
+        
+        emitFixed(m, in, "movl $", low, ", %eax\n", Registers::EAX);
+        emitFixed(m, in, "movl $", high, ", %edx\n", Registers::EDX);
+    }
+
+    template<Operands::OperandType S>
+    void divw(Machine& m, const Instruction& in){
+        Operands::Operand op_s, ax, dx;
+        uint16_t val_s;
+        uint32_t dx_ax;
+        m.flags.clear(); // undefined after div
+
+        op_s = Operands::resolve<S>(m, in.src, 2);
+        val_s = (uint16_t)Operands::readOperand<S>(m, op_s);
+
+        ax = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AX };
+        dx = { .type = Operands::OperandType::REGISTER, .regTag = Registers::DX };
+
+        dx_ax = ((uint32_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, dx) << 16) | (uint32_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, ax);
+
+        uint16_t cat = dx_ax / val_s;
+        uint16_t rest = dx_ax % val_s;
+
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, ax, cat);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, dx, rest);
+
+        emitFixed(m, in, "movw $", cat, ", %ax\n", Registers::AX);
+        emitFixed(m, in, "movw $", rest, ", %dx\n", Registers::DX);
+    }
+
+    template<Operands::OperandType S>
+    void mulw(Machine& m, const Instruction& in){
+        Operands::Operand op_s, ax, dx;
+        uint16_t val_s;
+        uint32_t result;
+
+        op_s = Operands::resolve<S>(m, in.src, 2);
+        val_s = (uint16_t)Operands::readOperand<S>(m, op_s);
+
+        ax = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AX };
+        dx = { .type = Operands::OperandType::REGISTER, .regTag = Registers::DX };
+
+        uint16_t ax_val = (uint16_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, ax);
+        result = (uint32_t)ax_val * val_s;
+
+        uint16_t high = (uint16_t)(result >> 16);
+        uint16_t low = (uint16_t)result;
+
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, ax, low);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, dx, high);
+        m.flags.set(Flags::Op::MUL, 2, ax_val, val_s, low, high != 0);
+
+        emitFixed(m, in, "movw $", low, ", %ax\n", Registers::AX);
+        emitFixed(m, in, "movw $", high, ", %dx\n", Registers::DX);
+    }
+
+    template<Operands::OperandType S>
+    void divb(Machine& m, const Instruction& in){
+        Operands::Operand op_s, al, ah;
+        uint8_t val_s;
+        uint16_t ah_al;
+        m.flags.clear(); // undefined after div
+
+        op_s = Operands::resolve<S>(m, in.src, 1);
+        val_s = (uint8_t)Operands::readOperand<S>(m, op_s);
+
+        al = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AL };
+        ah = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AH };
+
+        ah_al = ((uint16_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, ah) << 8) | (uint8_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, al);
+
+        uint8_t cat = ah_al / val_s;
+        uint8_t rest = ah_al % val_s;
+
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, al, cat);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, ah, rest);
+
+        emitFixed(m, in, "movb $", cat, ", %al\n", Registers::AL);
+        emitFixed(m, in, "movb $", rest, ", %ah\n", Registers::AH);
+    }
+
+    template<Operands::OperandType S>
+    void mulb(Machine& m, const Instruction& in){
+        Operands::Operand op_s, al, ah;
+        uint8_t val_s;
+        uint16_t result;
+
+        op_s = Operands::resolve<S>(m, in.src, 1);
+        val_s = (uint8_t)Operands::readOperand<S>(m, op_s);
+
+        al = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AL };
+        ah = { .type = Operands::OperandType::REGISTER, .regTag = Registers::AH };
+
+        uint8_t al_val = (uint8_t)Operands::readOperand<Operands::OperandType::REGISTER>(m, al);
+        result = (uint16_t)al_val * val_s;
+
+        uint8_t high = (uint8_t)(result >> 8);
+        uint8_t low = (uint8_t)result;
+
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, al, low);
+        Operands::writeOperand<Operands::OperandType::REGISTER>(m, ah, high);
+        m.flags.set(Flags::Op::MUL, 1, al_val, val_s, low, high != 0);
+
+        emitFixed(m, in, "movb $", low, ", %al\n", Registers::AL);
+        emitFixed(m, in, "movb $", high, ", %ah\n", Registers::AH);
+    }
+    template<Operands::OperandType S, Operands::OperandType D>
+    void mov(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val = Operands::readOperand<S>(m, op_s);
+        Operands::writeOperand<D>(m, op_d, val);
+        
+        // Label references like $v, $label are kept as written
+        if(S == Operands::OperandType::ADDRESS || 
+           D == Operands::OperandType::ADDRESS ||
+           in.src.isLabel){
+            emitText(m, in, in.text->written);
+        } else {
+            // Daca src e registru sau o valoare instanta sa scrie cu valoarea simulata
+            emitValue(m, in, val, op_d.address);
+        }
+    }
+
+
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void _or(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto val_d = Operands::readOperand<D>(m, op_d);
+        val_d = val_d | val_s;
+        Operands::writeOperand<D>(m, op_d, val_d);
+        m.flags.set(Flags::Op::LOGIC, size, val_d, val_s, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+    }
+    template<Operands::OperandType S, Operands::OperandType D>
+    void _xor(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto val_d = Operands::readOperand<D>(m, op_d);
+        val_d = val_d ^ val_s;
+        Operands::writeOperand<D>(m, op_d, val_d);
+        m.flags.set(Flags::Op::LOGIC, size, val_d, val_s, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+    }
+    template<Operands::OperandType S, Operands::OperandType D>
+    void _and(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto val_d = Operands::readOperand<D>(m, op_d);
+        val_d = val_d & val_s;
+        Operands::writeOperand<D>(m, op_d, val_d);
+        m.flags.set(Flags::Op::LOGIC, size, val_d, val_s, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+
+    }
+
+    template<Operands::OperandType S>
+    void inc(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_d;
+        op_d = Operands::resolve<S>(m, in.src, size);
+        auto old = Operands::readOperand<S>(m, op_d);
+        auto val_d = old + 1;
+        Operands::writeOperand<S>(m, op_d, val_d);
+        m.flags.set(Flags::Op::INC, size, old, 1, val_d, m.flags.cf());
+        
+        emitValue(m, in, val_d, op_d.address);
+    }
+    template<Operands::OperandType S>
+    void dec(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_d;
+        op_d = Operands::resolve<S>(m, in.src, size);
+        auto old = Operands::readOperand<S>(m, op_d);
+        auto val_d = old - 1;
+        Operands::writeOperand<S>(m, op_d, val_d);
+        m.flags.set(Flags::Op::DEC, size, old, 1, val_d, m.flags.cf());
+        
+        emitValue(m, in, val_d, op_d.address);
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void shl(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto old = Operands::readOperand<D>(m, op_d);
+        auto val_d = old << val_s;
+        Operands::writeOperand<D>(m, op_d, val_d);
+        // A count of 0 (mod 32) leaves the flags alone
+        if(uint32_t count = static_cast<uint32_t>(val_s) & 31)
+            m.flags.set(Flags::Op::SHL, size, old, count, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void shr(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto old = Operands::readOperand<D>(m, op_d);
+        auto val_d = static_cast<int32_t>(static_cast<uint32_t>(old) >> val_s);
+        Operands::writeOperand<D>(m, op_d, val_d);
+        // A count of 0 (mod 32) leaves the flags alone
+        if(uint32_t count = static_cast<uint32_t>(val_s) & 31)
+            m.flags.set(Flags::Op::SHR, size, old, count, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void sar(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto old = Operands::readOperand<D>(m, op_d);
+        auto val_d = old >> val_s;
+        Operands::writeOperand<D>(m, op_d, val_d);
+        // A count of 0 (mod 32) leaves the flags alone
+        if(uint32_t count = static_cast<uint32_t>(val_s) & 31)
+            m.flags.set(Flags::Op::SAR, size, old, count, val_d);
+        
+        if constexpr(D == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val_d, op_d.address);
+        }
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void lea(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        if constexpr(S == Operands::OperandType::ADDRESS){
+            Operands::writeOperand<D>(m, op_d, op_s.address);
+            emitText(m, in, in.text->written);
+        }
+    }
+
+    template<Operands::OperandType S>
+    void push(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        m.regs.esp -= 4;
+        Operands::Operand stack ={
+            .type=Operands::OperandType::ADDRESS,
+            .size=4,
+            .address=(uint32_t)m.regs.esp
+        };
+        Operands::writeOperand<Operands::OperandType::ADDRESS>(m, stack, val_s);
+        
+        emitText(m, in, in.text->written);
+    }
+
+    template<Operands::OperandType S>
+    void pop(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_d;
+        op_d = Operands::resolve<S>(m, in.src, size);
+        Operands::Operand stack ={
+            .type=Operands::OperandType::ADDRESS,
+            .size=4,
+            .address=(uint32_t)m.regs.esp
+        };
+        auto val_d = Operands::readOperand<Operands::OperandType::ADDRESS>(m, stack);
+        Operands::writeOperand<S>(m, op_d, val_d);
+        m.regs.esp += 4;
+        
+        emitText(m, in, in.text->written);
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void test(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto val_d = Operands::readOperand<D>(m, op_d);
+        m.flags.set(Flags::Op::LOGIC, size, val_d, val_s, val_d & val_s);
+    }
+
+    template<Operands::OperandType S, Operands::OperandType D>
+    void cmp(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s, op_d;
+        op_s = Operands::resolve<S>(m, in.src, size);
+        op_d = Operands::resolve<D>(m, in.dest, size);
+        auto val_s = Operands::readOperand<S>(m, op_s);
+        auto val_d = Operands::readOperand<D>(m, op_d);
+        m.flags.set(Flags::Op::SUB, size, val_d, val_s, val_d - val_s);
+    }
+
+    // add with the carry in
+    template<Operands::OperandType S, Operands::OperandType D>
+    void adc(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s = Operands::resolve<S>(m, in.src, size);
+        Operands::Operand op_d = Operands::resolve<D>(m, in.dest, size);
+        int32_t val_s = Operands::readOperand<S>(m, op_s);
+        int32_t val_d = Operands::readOperand<D>(m, op_d);
+        bool carry = m.flags.cf();
+
+        int32_t sum = val_d + val_s + carry;
+        Operands::writeOperand<D>(m, op_d, sum);
+        m.flags.set(Flags::Op::ADD, size, val_d, val_s, sum, carry);
+
+        emitValue(m, in, sum, op_d.address);
+    }
+
+    // sub with the borrow in
+    template<Operands::OperandType S, Operands::OperandType D>
+    void sbb(Machine& m, const Instruction& in){
+        uint8_t size = in.size;
+        Operands::Operand op_s = Operands::resolve<S>(m, in.src, size);
+        Operands::Operand op_d = Operands::resolve<D>(m, in.dest, size);
+        int32_t val_s = Operands::readOperand<S>(m, op_s);
+        int32_t val_d = Operands::readOperand<D>(m, op_d);
+        bool borrow = m.flags.cf();
+
+        int32_t sub = val_d - val_s - borrow;
+        Operands::writeOperand<D>(m, op_d, sub);
+        m.flags.set(Flags::Op::SUB, size, val_d, val_s, sub, borrow);
+
+        emitValue(m, in, sub, op_d.address);
+    }
+
+    // set<cc> r/m8: becomes movb $0/$1, dest
+    template<Operands::OperandType S>
+    void setcc(Machine& m, const Instruction& in){
+        Operands::Operand op_d = Operands::resolve<S>(m, in.src, 1);
+        int32_t value = m.flags.test(in.cond);
+        Operands::writeOperand<S>(m, op_d, value);
+        emitValue(m, in, value, op_d.address);
+    }
+
+    // cmov<cc> src, reg: a mov when the condition holds, nothing otherwise
+    template<Operands::OperandType S, Operands::OperandType D>
+    void cmovcc(Machine& m, const Instruction& in){
+        if(!m.flags.test(in.cond)) return;
+        Operands::Operand op_s = Operands::resolve<S>(m, in.src, in.size);
+        Operands::Operand op_d = Operands::resolve<D>(m, in.dest, in.size);
+        auto val = Operands::readOperand<S>(m, op_s);
+        Operands::writeOperand<D>(m, op_d, val);
+
+        if constexpr(S == Operands::OperandType::ADDRESS){
+            emitText(m, in, in.text->written);
+        } else {
+            emitValue(m, in, val, op_d.address);
+        }
+    }
+
+    void jmp(Machine& m, const Instruction& in){
+        m.regs.eip = in.target;
+    }
+
+    void loop(Machine& m, const Instruction& in){
+        m.regs.ecx--;
+        if(m.regs.ecx != 0){
+            m.regs.eip = in.target;
+        } else {
+            // When loop doesn't jump, increment eip normally
+            m.regs.eip++;
+        }
+    }
+    void call(Machine& m, const Instruction& in){
+        if(in.external){
+            emitText(m, in, in.text->written);
+            m.regs.eip++;  // For external calls, increment eip manually
+            return;
+        }
+        
+        uint32_t returnAddr = static_cast<uint32_t>(m.regs.eip + 1);
+        m.regs.esp -= 4;
+        Operands::Operand stackSlot = {
+            .type=Operands::OperandType::ADDRESS,
+            .size=4,
+            .address=(uint32_t)m.regs.esp
+        };
+        Operands::writeOperand<Operands::OperandType::ADDRESS>(m, stackSlot, static_cast<int32_t>(returnAddr));
+
+        m.regs.eip = in.target;
+    }
+    void ret(Machine& m){
+        Operands::Operand stackSlot = {
+            .type=Operands::OperandType::ADDRESS,
+            .size=4,
+            .address=(uint32_t)m.regs.esp
+        };
+        uint32_t returnAddr = static_cast<uint32_t>(Operands::readOperand<Operands::OperandType::ADDRESS>(m, stackSlot));
+        m.regs.esp += 4;
+
+        if(returnAddr < m.program.size()){
+            m.regs.eip = static_cast<int32_t>(returnAddr);
+        } else {
+            m.regs.eip = m.program.size();
+        }
+    }
+
+    template<Operands::OperandType S>
+    void multiply(Machine& m, const Instruction& in){
+        if(in.size == 4) mul<S>(m, in);
+        else if(in.size == 2) mulw<S>(m, in);
+        else mulb<S>(m, in);
+    }
+
+    template<Operands::OperandType S>
+    void divide(Machine& m, const Instruction& in){
+        if(in.size == 4) div<S>(m, in);
+        else if(in.size == 2) divw<S>(m, in);
+        else divb<S>(m, in);
+    }
+
+#define KIND_R Operands::OperandType::REGISTER
+#define KIND_I Operands::OperandType::IMMEDIATE
+#define KIND_M Operands::OperandType::ADDRESS
+#define KIND_N Operands::OperandType::NONE
+
+#define FOR_KINDS2(X, TYPE, FN) \
+    X(TYPE, FN, R, R) X(TYPE, FN, R, I) X(TYPE, FN, R, M) \
+    X(TYPE, FN, I, R) X(TYPE, FN, I, I) X(TYPE, FN, I, M) \
+    X(TYPE, FN, M, R) X(TYPE, FN, M, I) X(TYPE, FN, M, M)
+#define FOR_KINDS1(X, TYPE, FN) X(TYPE, FN, R, N) X(TYPE, FN, I, N) X(TYPE, FN, M, N)
+
+#define DATA_HANDLERS(X2, X1) \
+    FOR_KINDS2(X2, MOV, mov) FOR_KINDS2(X2, ADD, add) FOR_KINDS2(X2, SUB, sub) \
+    FOR_KINDS2(X2, AND, _and) FOR_KINDS2(X2, OR, _or) FOR_KINDS2(X2, XOR, _xor) \
+    FOR_KINDS2(X2, SHL, shl) FOR_KINDS2(X2, SHR, shr) FOR_KINDS2(X2, SAR, sar) \
+    FOR_KINDS2(X2, LEA, lea) FOR_KINDS2(X2, TEST, test) FOR_KINDS2(X2, CMP, cmp) \
+    FOR_KINDS2(X2, ADC, adc) FOR_KINDS2(X2, SBB, sbb) FOR_KINDS2(X2, CMOVCC, cmovcc) \
+    FOR_KINDS1(X1, SETCC, setcc) \
+    FOR_KINDS1(X1, MUL, multiply) FOR_KINDS1(X1, DIV, divide) \
+    FOR_KINDS1(X1, INC, inc) FOR_KINDS1(X1, DEC, dec) \
+    FOR_KINDS1(X1, PUSH, push) FOR_KINDS1(X1, POP, pop)
+
+#define CONTROL_HANDLERS(X) \
+    X(LABEL) X(VERBATIM) X(UNKNOWN) \
+    X(JCC) X(JMP) X(LOOP) X(CALL) X(RET)
+
+// Instructions that fall straight into the one after them without a dispatch:
+// cmp/test/dec + jcc, inc + jmp, movl mem, reg + addl reg, reg.
+// INTO_<type> is the handler they fall into, fusedWith() its id.
+#define FUSED_HANDLERS(X2, X1) \
+    FOR_KINDS2(X2, CMP, cmp) FOR_KINDS2(X2, TEST, test) FOR_KINDS1(X1, DEC, dec) \
+    FOR_KINDS1(X1, INC, inc) X2(MOV, mov, M, R)
+#define INTO_CMP L_JCC
+#define INTO_TEST L_JCC
+#define INTO_DEC L_JCC
+#define INTO_INC L_JMP
+#define INTO_MOV L_ADD_RR
+
+// Counts the instruction about to run when profiling for --stats
+#define PROFILE_HOOK() if constexpr(PROFILE) profile(m)
+#if THREADED_DISPATCH
+    #define TARGET(name, id) name:
+    #define DISPATCH() PROFILE_HOOK(); goto *code[m.regs.eip]
+    #define DISPATCH_CHECKED() PROFILE_HOOK(); goto *checkedCode[m.regs.eip]
+    // Inside a basic block: its fuel was reserved when it was entered
+    #define NEXT() --fuel; DISPATCH()
+    // The copies used when the slice ends inside the block, one check per instruction
+    #define NEXT_CHECKED() if(--fuel == 0) goto CHECK; DISPATCH_CHECKED()
+    // Handlers shared by both copies (control flow, labels, verbatim lines): reserve
+    // the rest of the block the next instruction is in, or step through it checked
+    #define NEXT_BLOCK() \
+        if(--fuel == 0) goto CHECK; \
+        if(fuel <= rest[m.regs.eip]){ DISPATCH_CHECKED(); } \
+        DISPATCH()
+#else
+    #define TARGET(name, id) case id:
+    #define NEXT() if(--fuel == 0) goto CHECK; continue
+    #define NEXT_BLOCK() NEXT()
+#endif
+#define CONTROL(TYPE) TARGET(L_##TYPE, handlerId(Type::TYPE, KIND_N, KIND_N))
+// A jump back from `from` may start a loop --summarize-loops can skip
+#define SUMMARIZE(from) \
+    if(m.loops.enabled && static_cast<uint32_t>(m.regs.eip) <= from) m.loops.fastForward(m, from, budget())
+// ...and the rest of it may run as native code (--jit, not while profiling). The
+// jump itself is counted after, so the loop gets all the fuel but one.
+#define NATIVE(from) \
+    if constexpr(!PROFILE) \
+        if(m.jit.enabled && static_cast<uint32_t>(m.regs.eip) <= from) fuel -= runNative(m, from, fuel - 1)
+#define JUMP_IF(cond) \
+    if(cond){ \
+        const uint32_t from = m.regs.eip; \
+        jmp(m, m.program[from]); \
+        SUMMARIZE(from); \
+        NATIVE(from); \
+    }else m.regs.eip++; \
+    NEXT_BLOCK();
+
+    // Handler id of what a fused instruction falls into, HANDLER_COUNT when it is not fused
+    constexpr uint16_t fusedWith(Type type){
+        using Operands::OperandType;
+        switch(type){
+            case Type::CMP:
+            case Type::TEST:
+            case Type::DEC: return handlerId(Type::JCC, OperandType::NONE, OperandType::NONE);
+            case Type::INC: return handlerId(Type::JMP, OperandType::NONE, OperandType::NONE);
+            case Type::MOV: return handlerId(Type::ADD, OperandType::REGISTER, OperandType::REGISTER);
+            default: return HANDLER_COUNT;
+        }
+    }
+
+    // The line the handler of an instruction --jit ran would have emitted
+    void replay(Machine& m, const Jit::Record& record){
+        using Operands::OperandType;
+        const Instruction& in = m.program[record.index];
+        switch(in.type){
+            case Type::VERBATIM:
+                emitText(m, in, in.text->line);
+                return;
+            case Type::LEA:
+                emitText(m, in, in.text->written);
+                return;
+            case Type::MOV:
+                if(in.src.type == OperandType::ADDRESS || in.dest.type == OperandType::ADDRESS || in.src.isLabel)
+                    emitText(m, in, in.text->written);
+                else emitValue(m, in, record.value, record.address);
+                return;
+            case Type::SUB:
+            case Type::AND:
+            case Type::OR:
+            case Type::XOR:
+                if(in.dest.type == OperandType::ADDRESS) emitText(m, in, in.text->written);
+                else emitValue(m, in, record.value, record.address);
+                return;
+            default: // add, inc, dec, shifts
+                emitValue(m, in, record.value, record.address);
+        }
+    }
+
+    // Runs the loop whose back edge is at branch natively, then emits what it did
+    uint64_t runNative(Machine& m, uint32_t branch, uint64_t budget){
+        const uint64_t ran = m.jit.run(m, branch, budget);
+        const std::vector<Jit::Record>& log = m.jit.log();
+        for(size_t i = 0; i < m.jit.logged(); i++) replay(m, log[i]);
+        return ran;
+    }
+
+    // Label the instruction at eip belongs to
+    static std::string labelOf(const Machine& m, uint32_t eip){
+        for(uint32_t i = std::min<uint32_t>(eip + 1, m.program.size()); i-- > 0; )
+            if(m.program[i].type == Type::LABEL){
+                std::string_view line = m.program[i].text->line;
+                return std::string(line.substr(0, line.find_last_not_of(":\n") + 1));
+            }
+        return "?";
+    }
+
+    // Between slices of execution: throws LimitExceeded once the conversion is over a limit
+    static void checkLimits(const Machine& m){
+        const char* reason = nullptr;
+        const Machine::Limits& limits = m.limits;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m.started).count();
+        if(limits.instructions && m.executed >= limits.instructions) reason = "instruction budget exhausted";
+        else if(limits.seconds > 0 && seconds >= limits.seconds) reason = "time limit reached";
+        else if(limits.outputBytes && m.out.overflowed()) reason = "output size cap reached";
+        if(!reason) return;
+
+        uint32_t eip = static_cast<uint32_t>(m.regs.eip);
+        std::ostringstream msg;
+        msg << reason << " at eip " << eip << " (" << labelOf(m, eip) << "): "
+            << m.executed << " instructions, " << m.out.bytes() << " bytes emitted, "
+            << seconds << "s";
+        throw LimitExceeded(msg.str());
+    }
+
+    static inline void profile(Machine& m){
+        Stats::Counters& stats = m.stats;
+        uint32_t eip = static_cast<uint32_t>(m.regs.eip);
+        if(eip < stats.hits.size()) stats.hits[eip]++;
+        // The stack starts at the top of memory; esp above it (more pops than pushes) is not depth
+        uint32_t depth = static_cast<uint32_t>(m.memorySize) - static_cast<uint32_t>(m.regs.esp);
+        if(depth > stats.stackDepth && depth < m.memorySize) stats.stackDepth = depth;
+    }
+
+    template<bool PROFILE>
+    static void execute(Machine& m, uint32_t entry){
+        const uint32_t end = m.program.size();
+        m.regs.eip = entry;
+
+        // Instructions left in the current slice; limits are checked when it runs out
+        constexpr uint64_t SLICE = 1 << 16;
+        auto sliceLength = [&m]{
+            uint64_t left = m.limits.instructions ? m.limits.instructions - m.executed : SLICE;
+            return left < SLICE ? left : SLICE;
+        };
+        uint64_t slice = sliceLength(), fuel = slice;
+        // Counts the last slice however run() is left
+        struct Count{
+            Machine& m;
+            const uint64_t& slice;
+            const uint64_t& fuel;
+            ~Count(){ m.executed += slice - fuel; }
+        } count{m, slice, fuel};
+        // Instructions the limit still allows once the running slice is done
+        auto budget = [&]{
+            return m.limits.instructions ? m.limits.instructions - m.executed - slice : UINT64_MAX;
+        };
+
+#if THREADED_DISPATCH
+        // Every data handler exists twice: a fast copy that only counts fuel and a
+        // checked copy that stops when it runs out
+        const void* table[HANDLER_COUNT];
+        const void* checked[HANDLER_COUNT];
+        for(auto& t : table) t = &&BAD;
+        for(auto& t : checked) t = &&BAD;
+        #define FILL_DATA(TYPE, FN, S, D) \
+            table[handlerId(Type::TYPE, KIND_##S, KIND_##D)] = &&L_##TYPE##_##S##D; \
+            checked[handlerId(Type::TYPE, KIND_##S, KIND_##D)] = &&C_##TYPE##_##S##D;
+        #define FILL_CONTROL(TYPE) table[handlerId(Type::TYPE, KIND_N, KIND_N)] = checked[handlerId(Type::TYPE, KIND_N, KIND_N)] = &&L_##TYPE;
+        DATA_HANDLERS(FILL_DATA, FILL_DATA)
+        CONTROL_HANDLERS(FILL_CONTROL)
+        #undef FILL_DATA
+        #undef FILL_CONTROL
+        const void* fused[HANDLER_COUNT] = {};
+        #define FILL_FUSED(TYPE, FN, S, D) fused[handlerId(Type::TYPE, KIND_##S, KIND_##D)] = &&F_##TYPE##_##S##D;
+        FUSED_HANDLERS(FILL_FUSED, FILL_FUSED)
+        #undef FILL_FUSED
+
+        // The program as threaded code, one label address per instruction plus a
+        // sentinel for falling off the end. rest[i] is how many instructions are
+        // left in i's basic block: entering it with more fuel than that runs the
+        // whole block without checks.
+        const Cfg::Graph graph = Cfg::build(m);
+        std::vector<const void*> code(end + 1), checkedCode(end + 1);
+        std::vector<uint32_t> rest(end + 1, 0);
+        for(uint32_t i = 0; i < end; i++){
+            const Instruction& in = m.program[i];
+            const bool fuse = fused[in.handler] && i + 1 < end && m.program[i + 1].handler == fusedWith(in.type) &&
+                              graph.blockOf[i + 1] == graph.blockOf[i];
+            rest[i] = graph.blocks[graph.blockOf[i]].end - i;
+            checkedCode[i] = checked[in.handler];
+            // A data instruction falling into the next block (only the entry point
+            // starts one without a label) leaves it to check the fuel
+            code[i] = fuse ? fused[in.handler] : rest[i] == 1 ? checked[in.handler] : table[in.handler];
+        }
+        code[end] = checkedCode[end] = &&END;
+        goto ENTER;
+#else
+        while(true){
+            DISPATCH:
+            if(static_cast<uint32_t>(m.regs.eip) >= end) goto END;
+            PROFILE_HOOK();
+            switch(m.program[m.regs.eip].handler){
+#endif
+        #define RUN_DATA2(TYPE, FN, S, D) \
+            TARGET(L_##TYPE##_##S##D, handlerId(Type::TYPE, KIND_##S, KIND_##D)) \
+                FN<KIND_##S, KIND_##D>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                NEXT();
+        #define RUN_DATA1(TYPE, FN, S, D) \
+            TARGET(L_##TYPE##_##S##D, handlerId(Type::TYPE, KIND_##S, KIND_##D)) \
+                FN<KIND_##S>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                NEXT();
+        DATA_HANDLERS(RUN_DATA2, RUN_DATA1)
+        #undef RUN_DATA2
+        #undef RUN_DATA1
+
+#if THREADED_DISPATCH
+        #define RUN_CHECKED2(TYPE, FN, S, D) \
+            C_##TYPE##_##S##D: \
+                FN<KIND_##S, KIND_##D>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                NEXT_CHECKED();
+        #define RUN_CHECKED1(TYPE, FN, S, D) \
+            C_##TYPE##_##S##D: \
+                FN<KIND_##S>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                NEXT_CHECKED();
+        DATA_HANDLERS(RUN_CHECKED2, RUN_CHECKED1)
+        #undef RUN_CHECKED2
+        #undef RUN_CHECKED1
+
+        // Superinstructions, only in fast blocks: the next handler is entered by a direct jump
+        #define RUN_FUSED2(TYPE, FN, S, D) \
+            F_##TYPE##_##S##D: \
+                FN<KIND_##S, KIND_##D>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                --fuel; \
+                PROFILE_HOOK(); \
+                goto INTO_##TYPE;
+        #define RUN_FUSED1(TYPE, FN, S, D) \
+            F_##TYPE##_##S##D: \
+                FN<KIND_##S>(m, m.program[m.regs.eip]); \
+                m.regs.eip++; \
+                --fuel; \
+                PROFILE_HOOK(); \
+                goto INTO_##TYPE;
+        FUSED_HANDLERS(RUN_FUSED2, RUN_FUSED1)
+        #undef RUN_FUSED2
+        #undef RUN_FUSED1
+#endif
+
+        CONTROL(LABEL)
+            m.regs.eip++;
+            NEXT_BLOCK();
+        CONTROL(VERBATIM)
+            emitText(m, m.program[m.regs.eip], m.program[m.regs.eip].text->line);
+            m.regs.eip++;
+            NEXT_BLOCK();
+        CONTROL(UNKNOWN)
+            *m.err << m.program[m.regs.eip].text->mnemonic << " not known";
+            m.regs.eip++;
+            NEXT_BLOCK();
+        CONTROL(JCC) JUMP_IF(m.flags.test(m.program[m.regs.eip].cond))
+        CONTROL(JMP){
+            const uint32_t from = m.regs.eip;
+            jmp(m, m.program[from]);
+            NATIVE(from);
+            NEXT_BLOCK();
+        }
+        CONTROL(LOOP){
+            const uint32_t from = m.regs.eip;
+            loop(m, m.program[from]);
+            SUMMARIZE(from);
+            NATIVE(from);
+            NEXT_BLOCK();
+        }
+        CONTROL(CALL)
+            call(m, m.program[m.regs.eip]);
+            NEXT_BLOCK();
+        CONTROL(RET)
+            ret(m);
+            NEXT_BLOCK();
+
+#if THREADED_DISPATCH
+        BAD:
+#else
+            default:
+                goto BAD;
+            }
+        }
+        BAD:
+#endif
+        throw std::runtime_error("No handler for " + std::string(m.program[m.regs.eip].text->line));
+
+        CHECK:
+        m.executed += slice;
+        slice = fuel = 0;
+        if(static_cast<uint32_t>(m.regs.eip) >= end) goto END;
+        checkLimits(m);
+        slice = fuel = sliceLength();
+#if THREADED_DISPATCH
+        ENTER:
+        if(fuel <= rest[m.regs.eip]){ DISPATCH_CHECKED(); }
+        DISPATCH();
+#else
+        goto DISPATCH;
+#endif
+        END:
+        PROFILE_HOOK();
+    }
+
+    void run(Machine& m, uint32_t entry){
+        if(!m.stats.enabled){
+            execute<false>(m, entry);
+            return;
+        }
+        // One counter per instruction, plus the end of the program
+        m.stats.hits.assign(m.program.size() + 1, 0);
+        execute<true>(m, entry);
+    }
+
+#undef JUMP_IF
+#undef NATIVE
+#undef SUMMARIZE
+#undef CONTROL
+#undef NEXT_BLOCK
+#undef NEXT_CHECKED
+#undef NEXT
+#undef DISPATCH_CHECKED
+#undef DISPATCH
+#undef PROFILE_HOOK
+#undef TARGET
+#undef INTO_MOV
+#undef INTO_INC
+#undef INTO_DEC
+#undef INTO_TEST
+#undef INTO_CMP
+#undef FUSED_HANDLERS
+#undef CONTROL_HANDLERS
+#undef DATA_HANDLERS
+#undef FOR_KINDS1
+#undef FOR_KINDS2
+#undef KIND_N
+#undef KIND_M
+#undef KIND_I
+#undef KIND_R
+}
@@ -0,0 +1,633 @@
+#include "Jit.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#include "Machine.hpp"
+
+#if HOST_JIT
+    #include <sys/mman.h>
+#endif
+
+using Instr::Type;
+using Operands::OperandSpec;
+using Operands::OperandType;
+
+namespace{
+    // What run() and the native code share; rdi points at it the whole time
+    struct Context{
+        Registers::File* regs;
+        const uint8_t* const* pages;
+        const uint8_t* zeroPage;
+        uint64_t memorySize;
+        Jit::Record* log; // next free record, past the last one on return
+        uint64_t left; // instructions the code may still run
+        uint32_t exit; // where the interpreter goes on
+        // The last instruction that set the flags, as Flags::Lazy::set takes it.
+        // inc/dec go apart: the CF they keep comes from the setter before them.
+        uint32_t a, b, result;
+        uint32_t incA, incResult;
+        uint8_t op, incOp;
+        uint8_t last;
+    };
+    enum Last : uint8_t{ NO_SETTER, BASE, INC_DEC };
+
+    static_assert(offsetof(Registers::File, ebp) == 7 * sizeof(int32_t), "guest registers in slot order");
+
+    enum Host : uint8_t{
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15,
+        NO_REG = 0xFF
+    };
+    // Fixed for the whole loop: rax, rcx and rdx are scratch, r8-r15 hold eax-ebp
+    constexpr Host CTX = RDI, LEFT = RSI, LOG = RBX, PAGES = RBP;
+
+    // Registers::File order: eax, ebx, ecx, edx, esi, edi, esp, ebp
+    uint8_t slotOf(Registers::Reg r){ return r < Registers::ESI ? r / 4 : 4 + (r - Registers::ESI); }
+    Host hostOf(Registers::Reg r){ return static_cast<Host>(R8 + slotOf(r)); }
+    bool full(Registers::Reg r){
+        using namespace Registers;
+        return r == EAX || r == EBX || r == ECX || r == EDX || r == ESI || r == EDI || r == ESP || r == EBP;
+    }
+
+    // The few x86-64 encodings the loops need. Memory operands are always
+    // [base + index * 2^scale + disp32] through a SIB byte, either register optional.
+    class Assembler{
+    public:
+        std::vector<uint8_t> bytes;
+
+        size_t size() const{ return bytes.size(); }
+        void byte(uint8_t b){ bytes.push_back(b); }
+        void dword(uint32_t v){
+            for(int i = 0; i < 4; i++, v >>= 8) byte(static_cast<uint8_t>(v));
+        }
+
+        // op r/m, reg with rm a register; reg may be an opcode extension
+        void rr(uint8_t op, uint8_t reg, uint8_t rm, bool wide = false){
+            rex(wide, reg, NO_REG, rm);
+            byte(op);
+            byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        void mem(uint8_t op, uint8_t reg, uint8_t base, uint8_t index, uint8_t scale, int32_t disp, bool wide = false){
+            rex(wide, reg, index, base);
+            byte(op);
+            const uint8_t sibIndex = index == NO_REG ? 4 : index & 7;
+            if(base == NO_REG){
+                byte((reg & 7) << 3 | 4);
+                byte(scale << 6 | sibIndex << 3 | 5);
+            }else{
+                byte(0x80 | (reg & 7) << 3 | 4);
+                byte(scale << 6 | sibIndex << 3 | (base & 7));
+            }
+            dword(static_cast<uint32_t>(disp));
+        }
+
+        void movImm(uint8_t reg, uint32_t v){
+            rex(false, 0, NO_REG, reg);
+            byte(0xB8 + (reg & 7));
+            dword(v);
+        }
+
+        void push(uint8_t reg){
+            if(reg >= R8) byte(0x41);
+            byte(0x50 + (reg & 7));
+        }
+        void pop(uint8_t reg){
+            if(reg >= R8) byte(0x41);
+            byte(0x58 + (reg & 7));
+        }
+
+        // rel32 jumps, patched once the target is known
+        size_t jcc(uint8_t cc){
+            byte(0x0F);
+            byte(0x80 | cc);
+            dword(0);
+            return size() - 4;
+        }
+        size_t jmp(){
+            byte(0xE9);
+            dword(0);
+            return size() - 4;
+        }
+        void patch(size_t at, size_t target){
+            uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+            std::memcpy(bytes.data() + at, &rel, 4);
+        }
+
+    private:
+        void rex(bool wide, uint8_t reg, uint8_t index, uint8_t base){
+            uint8_t r = 0x40 | wide << 3 | (reg >> 3 & 1) << 2;
+            if(index != NO_REG) r |= (index >> 3 & 1) << 1;
+            if(base != NO_REG) r |= base >> 3 & 1;
+            if(r != 0x40) byte(r);
+        }
+    };
+
+    // cc of the condition codes the jumps use
+    constexpr uint8_t CC_B = 0x2, CC_E = 0x4, CC_A = 0x7;
+
+    // An operand once it is in hand: an immediate or a host register
+    struct Value{
+        bool isImm;
+        uint32_t imm;
+        uint8_t reg;
+    };
+    Value imm(uint32_t v){ return {true, v, NO_REG}; }
+    Value reg(uint8_t r){ return {false, 0, r}; }
+
+    class Compiler{
+    public:
+        Compiler(const Machine& m, uint32_t head, uint32_t branch)
+            : m(m), head(head), branch(branch), at(branch - head + 1, 0){}
+
+        bool compile(std::vector<uint8_t>& out){
+            prologue();
+            std::vector<bool> target(at.size(), false);
+            for(uint32_t i = head; i <= branch; i++){
+                const Instr::Instruction& in = m.program[i];
+                if((in.type == Type::JCC || in.type == Type::JMP || in.type == Type::LOOP) &&
+                   in.target >= head && in.target <= branch)
+                    target[in.target - head] = true;
+            }
+            for(uint32_t i = head; i <= branch; i++){
+                at[i - head] = a.size();
+                if(target[i - head]) flagsLive = false; // reached from elsewhere
+                if(!instruction(i, m.program[i])) return false;
+            }
+            jumps.push_back({a.jmp(), branch + 1, EXIT});
+            finish();
+            out = std::move(a.bytes);
+            return true;
+        }
+
+    private:
+        enum Kind{ INSIDE, EXIT, BACK };
+        struct Jump{
+            size_t at;
+            uint32_t target;
+            Kind kind;
+        };
+
+        const Machine& m;
+        const uint32_t head, branch;
+        Assembler a;
+        std::vector<size_t> at; // native offset of each instruction
+        std::vector<Jump> jumps;
+        bool flagsLive = false; // host flags are the guest flags
+        bool overflowLive = false; // OF too, it is undefined after a shift by more than 1
+        bool carryLive = false; // CF too, inc and dec leave the host's as it was
+
+        static constexpr int32_t field(size_t offset){ return static_cast<int32_t>(offset); }
+
+        void prologue(){
+            for(uint8_t r : {RBX, RBP, R12, R13, R14, R15}) a.push(r);
+            a.mem(0x8B, LOG, CTX, NO_REG, 0, field(offsetof(Context, log)), true);
+            a.mem(0x8B, LEFT, CTX, NO_REG, 0, field(offsetof(Context, left)), true);
+            a.mem(0x8B, PAGES, CTX, NO_REG, 0, field(offsetof(Context, pages)), true);
+            a.mem(0x8B, RAX, CTX, NO_REG, 0, field(offsetof(Context, regs)), true);
+            for(uint8_t s = 0; s < 8; s++) a.mem(0x8B, R8 + s, RAX, NO_REG, 0, 4 * s);
+        }
+
+        // Exit stubs, back edges and the common way out
+        void finish(){
+            for(const Jump& j : jumps){
+                if(j.kind == INSIDE){
+                    a.patch(j.at, at[j.target - head]);
+                    continue;
+                }
+                a.patch(j.at, a.size());
+                if(j.kind == BACK){
+                    // Enough left for one more pass through the loop, else out
+                    a.rr(0x81, 7, LEFT, true);
+                    a.dword(static_cast<uint32_t>(at.size()));
+                    const size_t out = a.jcc(CC_B);
+                    a.patch(a.jmp(), at[j.target - head]);
+                    a.patch(out, a.size());
+                }
+                exitStub(j.target);
+            }
+            const size_t common = a.size();
+            for(size_t j : toCommon) a.patch(j, common);
+            a.mem(0x8B, RAX, CTX, NO_REG, 0, field(offsetof(Context, regs)), true);
+            for(uint8_t s = 0; s < 8; s++) a.mem(0x89, R8 + s, RAX, NO_REG, 0, 4 * s);
+            a.mem(0x89, LOG, CTX, NO_REG, 0, field(offsetof(Context, log)), true);
+            a.mem(0x89, LEFT, CTX, NO_REG, 0, field(offsetof(Context, left)), true);
+            for(uint8_t r : {R15, R14, R13, R12, RBP, RBX}) a.pop(r);
+            a.byte(0xC3);
+        }
+
+        std::vector<size_t> toCommon;
+        void exitStub(uint32_t eip){
+            a.mem(0xC7, 0, CTX, NO_REG, 0, field(offsetof(Context, exit)));
+            a.dword(eip);
+            toCommon.push_back(a.jmp());
+        }
+
+        void jumpTo(size_t rel, uint32_t from, uint32_t target){
+            if(target < head || target > branch) jumps.push_back({rel, target, EXIT});
+            else jumps.push_back({rel, target, target > from ? INSIDE : BACK});
+        }
+
+        void count(){ a.mem(0x8D, LEFT, LEFT, NO_REG, 0, -1, true); }
+
+        // eax = the guest address of op
+        bool address(const OperandSpec& op){
+            uint8_t scale;
+            switch(op.scale){
+                case 1: scale = 0; break;
+                case 2: scale = 1; break;
+                case 4: scale = 2; break;
+                case 8: scale = 3; break;
+                default: return false;
+            }
+            const uint8_t base = op.base == Registers::COUNT ? NO_REG : hostOf(op.base);
+            const uint8_t index = op.index == Registers::COUNT ? NO_REG : hostOf(op.index);
+            if(base == NO_REG && index == NO_REG) a.movImm(RAX, static_cast<uint32_t>(op.imm));
+            else a.mem(0x8D, RAX, base, index, scale, op.imm);
+            return true;
+        }
+
+        // rdx = host pointer to the 4 bytes at op, eax = their guest address. Leaves
+        // for the interpreter before instruction i when they cross a page, are out
+        // of range, or are to be written in a page that does not exist yet.
+        bool access(uint32_t i, const OperandSpec& op, bool write){
+            if(!address(op)) return false;
+            a.rr(0x89, RAX, RCX);
+            a.rr(0x81, 4, RCX);
+            a.dword(Mem::PAGE_SIZE - 1);
+            a.rr(0x81, 7, RCX);
+            a.dword(Mem::PAGE_SIZE - 4);
+            jumps.push_back({a.jcc(CC_A), i, EXIT});
+            a.mem(0x8D, RDX, RAX, NO_REG, 0, 4, true);
+            a.mem(0x3B, RDX, CTX, NO_REG, 0, field(offsetof(Context, memorySize)), true);
+            jumps.push_back({a.jcc(CC_A), i, EXIT});
+            a.rr(0x89, RAX, RDX, true);
+            a.rr(0xC1, 5, RDX, true);
+            a.byte(Mem::PAGE_BITS);
+            a.mem(0x8B, RDX, PAGES, RDX, 3, 0, true);
+            if(write){
+                a.mem(0x3B, RDX, CTX, NO_REG, 0, field(offsetof(Context, zeroPage)), true);
+                jumps.push_back({a.jcc(CC_E), i, EXIT});
+            }
+            a.rr(0x01, RCX, RDX, true);
+            flagsLive = false;
+            return true;
+        }
+
+        void load(uint8_t dst){ a.mem(0x8B, dst, RDX, NO_REG, 0, 0); }
+        void store(Value v){
+            if(v.isImm){
+                a.mem(0xC7, 0, RDX, NO_REG, 0, 0);
+                a.dword(v.imm);
+            }else a.mem(0x89, v.reg, RDX, NO_REG, 0, 0);
+        }
+        void move(uint8_t dst, Value v){
+            if(v.isImm) a.movImm(dst, v.imm);
+            else if(v.reg != dst) a.rr(0x89, v.reg, dst);
+        }
+        void toContext(size_t offset, Value v){
+            if(v.isImm){
+                a.mem(0xC7, 0, CTX, NO_REG, 0, field(offset));
+                a.dword(v.imm);
+            }else a.mem(0x89, v.reg, CTX, NO_REG, 0, field(offset));
+        }
+        void byteToContext(size_t offset, uint8_t v){
+            a.mem(0xC6, 0, CTX, NO_REG, 0, field(offset));
+            a.byte(v);
+        }
+        // ADD /0, OR /1, AND /4, SUB /5, XOR /6, CMP /7
+        void alu(uint8_t digit, uint8_t dst, Value v){
+            if(v.isImm){
+                a.rr(0x81, digit, dst);
+                a.dword(v.imm);
+            }else a.rr(digit * 8 + 1, v.reg, dst);
+        }
+
+        // The record the replay turns into the handler's line
+        void record(uint32_t i, const Value* value = nullptr, bool atAddress = false){
+            a.mem(0xC7, 0, LOG, NO_REG, 0, field(offsetof(Jit::Record, index)));
+            a.dword(i);
+            if(value){
+                if(value->isImm){
+                    a.mem(0xC7, 0, LOG, NO_REG, 0, field(offsetof(Jit::Record, value)));
+                    a.dword(value->imm);
+                }else a.mem(0x89, value->reg, LOG, NO_REG, 0, field(offsetof(Jit::Record, value)));
+                if(atAddress) a.mem(0x89, RAX, LOG, NO_REG, 0, field(offsetof(Jit::Record, address)));
+                else{
+                    a.mem(0xC7, 0, LOG, NO_REG, 0, field(offsetof(Jit::Record, address)));
+                    a.dword(0);
+                }
+            }
+            a.mem(0x8D, LOG, LOG, NO_REG, 0, sizeof(Jit::Record), true);
+        }
+
+        void setter(Flags::Op op){
+            byteToContext(offsetof(Context, op), static_cast<uint8_t>(op));
+            byteToContext(offsetof(Context, last), BASE);
+            flagsLive = overflowLive = carryLive = true;
+        }
+
+        static bool readsOverflow(Flags::Cond cond){
+            using Flags::Cond;
+            return cond == Cond::O || cond == Cond::NO || cond == Cond::L || cond == Cond::GE ||
+                   cond == Cond::LE || cond == Cond::G;
+        }
+
+        static bool readsCarry(Flags::Cond cond){
+            using Flags::Cond;
+            return cond == Cond::B || cond == Cond::AE || cond == Cond::BE || cond == Cond::A;
+        }
+
+        bool operand(const OperandSpec& op){
+            if(op.type == OperandType::REGISTER) return full(op.regTag);
+            return op.type == OperandType::IMMEDIATE || op.type == OperandType::ADDRESS;
+        }
+
+        // A source already in hand: the immediate, its register, or loaded into ecx
+        bool source(uint32_t i, const OperandSpec& op, Value& v){
+            if(op.type == OperandType::IMMEDIATE) v = imm(static_cast<uint32_t>(op.imm));
+            else if(op.type == OperandType::REGISTER) v = reg(hostOf(op.regTag));
+            else{
+                if(!access(i, op, false)) return false;
+                load(RCX);
+                v = reg(RCX);
+            }
+            return true;
+        }
+
+        bool instruction(uint32_t i, const Instr::Instruction& in){
+            switch(in.type){
+                case Type::LABEL:
+                    flagsLive = false;
+                    count();
+                    return true;
+                case Type::VERBATIM:
+                    record(i);
+                    count();
+                    return true;
+                case Type::JCC:
+                    if(!flagsLive || (!overflowLive && readsOverflow(in.cond)) || (!carryLive && readsCarry(in.cond)))
+                        return false;
+                    count();
+                    jumpTo(a.jcc(static_cast<uint8_t>(in.cond)), i, in.target);
+                    return true;
+                case Type::JMP:
+                    count();
+                    jumpTo(a.jmp(), i, in.target);
+                    return true;
+                case Type::LOOP:
+                    // ecx - 1 without touching the flags, jrcxz skips the jump back
+                    a.mem(0x8D, hostOf(Registers::ECX), hostOf(Registers::ECX), NO_REG, 0, -1);
+                    a.rr(0x89, hostOf(Registers::ECX), RCX);
+                    count();
+                    a.byte(0xE3);
+                    a.byte(5);
+                    jumpTo(a.jmp(), i, in.target);
+                    return true;
+                default:
+                    break;
+            }
+            if(in.size != 4) return false;
+            switch(in.type){
+                case Type::MOV: return mov(i, in);
+                case Type::ADD: return arithmetic(i, in, 0, Flags::Op::ADD);
+                case Type::OR: return arithmetic(i, in, 1, Flags::Op::LOGIC);
+                case Type::AND: return arithmetic(i, in, 4, Flags::Op::LOGIC);
+                case Type::SUB: return arithmetic(i, in, 5, Flags::Op::SUB);
+                case Type::XOR: return arithmetic(i, in, 6, Flags::Op::LOGIC);
+                case Type::CMP: return compare(i, in, 5, Flags::Op::SUB);
+                case Type::TEST: return compare(i, in, 4, Flags::Op::LOGIC);
+                case Type::INC: return step(i, in, 0, Flags::Op::INC);
+                case Type::DEC: return step(i, in, 1, Flags::Op::DEC);
+                case Type::SHL: return shift(i, in, 4, Flags::Op::SHL);
+                case Type::SHR: return shift(i, in, 5, Flags::Op::SHR);
+                case Type::SAR: return shift(i, in, 7, Flags::Op::SAR);
+                case Type::LEA:
+                    if(in.src.type != OperandType::ADDRESS || in.dest.type != OperandType::REGISTER ||
+                       !full(in.dest.regTag) || !address(in.src))
+                        return false;
+                    move(hostOf(in.dest.regTag), reg(RAX));
+                    record(i);
+                    count();
+                    return true;
+                default:
+                    return false; // stays interpreted
+            }
+        }
+
+        bool mov(uint32_t i, const Instr::Instruction& in){
+            const OperandType s = in.src.type, d = in.dest.type;
+            if(!operand(in.src) || !operand(in.dest) || d == OperandType::IMMEDIATE) return false;
+            if(s == OperandType::ADDRESS && d == OperandType::ADDRESS) return false;
+            if(d == OperandType::ADDRESS){
+                Value v = s == OperandType::IMMEDIATE ? imm(static_cast<uint32_t>(in.src.imm)) : reg(hostOf(in.src.regTag));
+                if(!access(i, in.dest, true)) return false;
+                store(v);
+                record(i);
+            }else{
+                const uint8_t dst = hostOf(in.dest.regTag);
+                Value v;
+                if(!source(i, in.src, v)) return false;
+                move(dst, v);
+                if(s == OperandType::ADDRESS || in.src.isLabel) record(i);
+                else record(i, &v);
+            }
+            count();
+            return true;
+        }
+
+        // add, sub, and, or, xor
+        bool arithmetic(uint32_t i, const Instr::Instruction& in, uint8_t digit, Flags::Op op){
+            const OperandType s = in.src.type, d = in.dest.type;
+            if(!operand(in.src) || !operand(in.dest) || d == OperandType::IMMEDIATE) return false;
+            if(s == OperandType::ADDRESS && d == OperandType::ADDRESS) return false;
+            Value v;
+            uint8_t dst;
+            if(d == OperandType::ADDRESS){
+                v = s == OperandType::IMMEDIATE ? imm(static_cast<uint32_t>(in.src.imm)) : reg(hostOf(in.src.regTag));
+                if(!access(i, in.dest, true)) return false;
+                load(RCX);
+                dst = RCX;
+            }else{
+                dst = hostOf(in.dest.regTag);
+                if(!source(i, in.src, v)) return false;
+            }
+            const bool logic = op == Flags::Op::LOGIC;
+            if(!logic) toContext(offsetof(Context, a), reg(dst));
+            toContext(offsetof(Context, b), v);
+            alu(digit, dst, v);
+            if(logic) toContext(offsetof(Context, a), reg(dst));
+            toContext(offsetof(Context, result), reg(dst));
+            setter(op);
+            const Value result = reg(dst);
+            if(d == OperandType::ADDRESS){
+                store(result);
+                if(in.type == Type::ADD) record(i, &result, true);
+                else record(i);
+            }else record(i, &result);
+            count();
+            return true;
+        }
+
+        // cmp and test: the same flags as sub and and, worked out in eax
+        bool compare(uint32_t i, const Instr::Instruction& in, uint8_t digit, Flags::Op op){
+            const OperandType s = in.src.type, d = in.dest.type;
+            if(!operand(in.src) || !operand(in.dest)) return false;
+            if(s == OperandType::ADDRESS && d == OperandType::ADDRESS) return false;
+            Value v, w;
+            if(d == OperandType::ADDRESS){
+                v = s == OperandType::IMMEDIATE ? imm(static_cast<uint32_t>(in.src.imm)) : reg(hostOf(in.src.regTag));
+                if(!access(i, in.dest, false)) return false;
+                load(RCX);
+                w = reg(RCX);
+            }else{
+                if(!source(i, in.src, v)) return false;
+                w = d == OperandType::IMMEDIATE ? imm(static_cast<uint32_t>(in.dest.imm)) : reg(hostOf(in.dest.regTag));
+            }
+            move(RAX, w);
+            toContext(offsetof(Context, a), reg(RAX));
+            toContext(offsetof(Context, b), v);
+            alu(digit, RAX, v);
+            toContext(offsetof(Context, result), reg(RAX));
+            setter(op);
+            count();
+            return true;
+        }
+
+        // inc and dec keep CF, so they are not the base setter
+        bool step(uint32_t i, const Instr::Instruction& in, uint8_t digit, Flags::Op op){
+            const OperandType d = in.src.type;
+            if(!operand(in.src) || d == OperandType::IMMEDIATE) return false;
+            uint8_t dst;
+            if(d == OperandType::ADDRESS){
+                if(!access(i, in.src, true)) return false;
+                load(RCX);
+                dst = RCX;
+            }else dst = hostOf(in.src.regTag);
+            toContext(offsetof(Context, incA), reg(dst));
+            a.rr(0xFF, digit, dst);
+            toContext(offsetof(Context, incResult), reg(dst));
+            byteToContext(offsetof(Context, incOp), static_cast<uint8_t>(op));
+            byteToContext(offsetof(Context, last), INC_DEC);
+            // The guest CF is the host's only if nothing touched it since the setter, access() included
+            carryLive = flagsLive && carryLive;
+            flagsLive = overflowLive = true;
+            const Value result = reg(dst);
+            if(d == OperandType::ADDRESS) store(result);
+            record(i, &result, d == OperandType::ADDRESS);
+            count();
+            return true;
+        }
+
+        // By an immediate 1-31 into a register, the only counts that always set the flags
+        bool shift(uint32_t i, const Instr::Instruction& in, uint8_t digit, Flags::Op op){
+            if(in.src.type != OperandType::IMMEDIATE || in.src.imm < 1 || in.src.imm > 31) return false;
+            if(in.dest.type != OperandType::REGISTER || !full(in.dest.regTag)) return false;
+            const uint8_t dst = hostOf(in.dest.regTag);
+            toContext(offsetof(Context, a), reg(dst));
+            toContext(offsetof(Context, b), imm(static_cast<uint32_t>(in.src.imm)));
+            a.rr(0xC1, digit, dst);
+            a.byte(static_cast<uint8_t>(in.src.imm));
+            toContext(offsetof(Context, result), reg(dst));
+            setter(op);
+            overflowLive = in.src.imm == 1;
+            const Value result = reg(dst);
+            record(i, &result);
+            count();
+            return true;
+        }
+    };
+}
+
+Jit::~Jit(){ reset(); }
+
+void Jit::reset(){
+#if HOST_JIT
+    for(const Code& code : codes) munmap(code.memory, code.size);
+#endif
+    codes.clear();
+    heat.clear();
+    codeOf.clear();
+    used = 0;
+}
+
+bool Jit::compile(const Machine& m, uint32_t branch, Code& code){
+#if HOST_JIT
+    const Instr::Instruction& back = m.program[branch];
+    const uint32_t head = back.target;
+    if(head > branch || branch - head >= MAX_LENGTH) return false;
+
+    std::vector<uint8_t> bytes;
+    if(!Compiler(m, head, branch).compile(bytes)) return false;
+
+    // Written while writable, then only executable
+    void* memory = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) return false;
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if(mprotect(memory, bytes.size(), PROT_READ | PROT_EXEC) != 0){
+        munmap(memory, bytes.size());
+        return false;
+    }
+    code = {.memory = memory, .size = bytes.size(), .length = branch - head + 1};
+    return true;
+#else
+    (void)m;
+    (void)branch;
+    (void)code;
+    return false;
+#endif
+}
+
+uint64_t Jit::run(Machine& m, uint32_t branch, uint64_t budget){
+    used = 0;
+    if(codeOf.size() != m.program.size()){
+        codeOf.assign(m.program.size(), UNKNOWN);
+        heat.assign(m.program.size(), 0);
+    }
+    int32_t& id = codeOf[branch];
+    if(id == REJECTED) return 0;
+    if(id == UNKNOWN){
+        if(++heat[branch] < HOT) return 0;
+        Code code;
+        if(!compile(m, branch, code)){
+            id = REJECTED;
+            return 0;
+        }
+        id = static_cast<int32_t>(codes.size());
+        codes.push_back(code);
+    }
+
+    // Every instruction leaves at most one record, so the budget bounds the log
+    const Code& code = codes[id];
+    const uint64_t left = std::min<uint64_t>(budget, LOG_SIZE);
+    if(left < code.length || static_cast<uint32_t>(m.regs.eip) != m.program[branch].target) return 0;
+    if(records.size() < LOG_SIZE) records.resize(LOG_SIZE);
+
+    Context context{
+        .regs = &m.regs,
+        .pages = m.memory.pages(),
+        .zeroPage = Mem::PagedMemory::zero(),
+        .memorySize = m.memory.size(),
+        .log = records.data(),
+        .left = left,
+        .exit = 0,
+        .a = 0, .b = 0, .result = 0,
+        .incA = 0, .incResult = 0,
+        .op = static_cast<uint8_t>(Flags::Op::CLEAR), .incOp = 0, // CLEAR: no base setter ran
+        .last = NO_SETTER
+    };
+    reinterpret_cast<void (*)(Context*)>(code.memory)(&context);
+
+    used = static_cast<size_t>(context.log - records.data());
+    m.regs.eip = static_cast<int32_t>(context.exit);
+    if(context.last != NO_SETTER){
+        Flags::Lazy base = m.flags;
+        if(context.op != static_cast<uint8_t>(Flags::Op::CLEAR))
+            base.set(static_cast<Flags::Op>(context.op), 4, context.a, context.b, context.result);
+        if(context.last == BASE) m.flags = base;
+        else m.flags.set(static_cast<Flags::Op>(context.incOp), 4, context.incA, 1, context.incResult, base.cf());
+    }
+    return left - context.left;
+}
@@ -0,0 +1,312 @@
+#include "Loader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include "Lexer.hpp"
+#include "Parallel.hpp"
+
+namespace{
+    enum Sections{
+        DATA,
+        TEXT,
+        NONE // no directive seen
+    };
+
+    // The words of a .data line are split at blanks and commas
+    constexpr std::string_view DATA_SEPARATORS = " \t\r\n\v\f,";
+    constexpr std::string_view TEXT_SEPARATORS = " \t\r\n\v\f";
+
+    // Below this many bytes per thread a file is read on one thread
+    constexpr size_t MIN_CHUNK = 1 << 20;
+
+    using Clock = std::chrono::steady_clock;
+
+    // A line without its comment (starting with # or ;) and trailing whitespace
+    std::string_view strip(std::string_view line){
+        line = line.substr(0, line.find_first_of("#;"));
+        size_t last = line.find_last_not_of(Lexer::BLANK);
+        return line.substr(0, last == std::string_view::npos ? 0 : last + 1);
+    }
+
+    // What one line does to the machine. Lines are read into these first, a large
+    // file on several threads, and then applied in file order on one thread.
+    struct Item{
+        enum Kind : uint8_t{
+            ECHO, // .data, .text, .extern: copied to the output
+            GLOBAL, // .global label: copied, label is the entry
+            DATA, // copied, label defined at memoryPeak, bytes laid out there
+            INSTRUCTION, // a .text line
+            LABEL, // a .text line defining label
+            WARNING, // a value that isn't a number, skipped
+            ERROR // loading stops
+        } kind;
+        uint8_t size; // DATA: element size of the label
+        std::string_view line;
+        std::string_view label;
+        uint32_t first, count; // DATA: the initialized bytes, in Chunk::bytes
+        uint32_t advance; // DATA: how far memoryPeak moves
+    };
+
+    struct Chunk{
+        std::string_view text;
+        Sections section = TEXT; // where the chunk starts
+        std::vector<Item> items;
+        std::vector<uint8_t> bytes; // initialized .data, little-endian
+        std::string error;
+        double data = 0, code = 0; // --stats: seconds spent on lines of each section
+    };
+
+    // The section the text leaves active, start when it has no directive
+    Sections lastSection(std::string_view text, Sections start){
+        while(!text.empty()){
+            std::string_view line = Lexer::line(text);
+            if(line.empty() || line[0] != '.') continue;
+            line = strip(line);
+            if(line == ".data") start = DATA;
+            else if(line == ".text") start = TEXT;
+        }
+        return start;
+    }
+
+    void readData(Chunk& c, std::string_view line, std::string& literal){
+        Item item = {.kind = Item::DATA, .size = 1, .line = line, .first = static_cast<uint32_t>(c.bytes.size())};
+        auto put = [&](uint32_t value, uint8_t size){
+            for(uint8_t i = 0; i < size; i++, value >>= 8)
+                c.bytes.push_back(static_cast<uint8_t>(value & 0xFF));
+        };
+
+        std::string_view lineWords = line;
+        std::string_view labelName = Lexer::word(lineWords, DATA_SEPARATORS);
+        if(!labelName.empty() && labelName.back() == ':'){
+            labelName.remove_suffix(1);
+        }
+        item.label = labelName;
+        std::string_view type = Lexer::word(lineWords, DATA_SEPARATORS);
+        if(type == ".byte" || type == ".ascii" || type == ".asciz")
+            item.size = 1;
+        else if(type == ".word")
+            item.size = 2;
+        else if(type == ".long")
+            item.size = 4;
+        else if(type == ".space")
+            item.size = 1;
+
+        std::string_view value = Lexer::word(lineWords, DATA_SEPARATORS);
+        if(type == ".space"){
+            // Memory starts zeroed, only the peak moves
+            if(!Lexer::number(value, item.advance)){
+                item.advance = 0;
+                c.items.push_back(item);
+                throw std::runtime_error("Could not parse value: " + std::string(value));
+            }
+            c.items.push_back(item);
+            return;
+        }
+
+        std::vector<Item> warnings;
+        if(!value.empty() && value.front() == '"'){
+            // The words are joined by single spaces, then the quotes dropped
+            literal.assign(value);
+            for(std::string_view temp; !(temp = Lexer::word(lineWords, DATA_SEPARATORS)).empty(); ){
+                literal += ' ';
+                literal.append(temp);
+            }
+            for(char ch : std::string_view(literal).substr(1, literal.length()-2))
+                put(static_cast<uint8_t>(ch), 1);
+            if(type == ".asciz") put('\n', 1);
+        }else{
+            do{
+                uint32_t v = 0;
+                if(!value.empty() && value.front() == '\''){
+                    v = static_cast<int32_t>(value.size() > 1 ? value[1] : '\0');
+                }else if(!Lexer::number(value, v)){
+                    // Base 0 detects 0x for hex, like stoul
+                    warnings.push_back({.kind = Item::WARNING, .line = value});
+                    continue;
+                }
+                put(v, item.size);
+            }while(!(value = Lexer::word(lineWords, DATA_SEPARATORS)).empty());
+        }
+        item.count = static_cast<uint32_t>(c.bytes.size()) - item.first;
+        item.advance = item.count;
+        c.items.push_back(item);
+        c.items.insert(c.items.end(), warnings.begin(), warnings.end());
+    }
+
+    void readText(Chunk& c, std::string_view line){
+        std::string_view lineWords = line;
+        std::string_view word = Lexer::word(lineWords, TEXT_SEPARATORS);
+        if(word == ".global"){
+            c.items.push_back({.kind = Item::GLOBAL, .line = line, .label = Lexer::word(lineWords, TEXT_SEPARATORS)});
+        }else if(line.back() == ':'){
+            std::string_view name = line.substr(0, line.size() - 1);
+            name.remove_prefix(std::min(name.find_first_not_of(" \t"), name.size()));
+            c.items.push_back({.kind = Item::LABEL, .line = line, .label = name});
+        }else{
+            c.items.push_back({.kind = Item::INSTRUCTION, .line = line});
+        }
+    }
+
+    // Turns the lines of a chunk into items, stopping at the first line that can't be loaded
+    void read(Chunk& c, bool timed){
+        std::string literal; // a string literal put back together, reused by every line
+        Sections section = c.section;
+        std::string_view text = c.text;
+        Clock::time_point start = timed ? Clock::now() : Clock::time_point{};
+        // --stats: the time since the last switch goes to the section that was active
+        auto lap = [&]{
+            Clock::time_point now = Clock::now();
+            (section == DATA ? c.data : c.code) += std::chrono::duration<double>(now - start).count();
+            start = now;
+        };
+
+        while(!text.empty()){
+            std::string_view line = strip(Lexer::line(text));
+            if(line.empty()) continue;
+
+            if(line == ".data" || line == ".text"){
+                if(timed) lap();
+                section = line == ".data" ? DATA : TEXT;
+                c.items.push_back({.kind = Item::ECHO, .line = line});
+            }else if(line.substr(0, 7) == ".extern"){
+                c.items.push_back({.kind = Item::ECHO, .line = line});
+            }else if(section == DATA){
+                try{
+                    readData(c, line, literal);
+                }catch(const std::exception& e){
+                    c.error = e.what();
+                    c.items.push_back({.kind = Item::ERROR});
+                    break;
+                }
+            }else{
+                readText(c, line);
+            }
+        }
+        if(timed) lap();
+    }
+
+    // Lays out one line's bytes at address, each element stored like the run loop would
+    void layOut(Machine& m, uint32_t address, const uint8_t* bytes, uint32_t count, uint8_t size){
+        if(static_cast<uint64_t>(address) + count <= m.memory.size()){
+            m.memory.write(address, bytes, count);
+            return;
+        }
+        // Fails on the first element out of range, with its address
+        for(uint32_t i = 0; i + size <= count; i += size){
+            uint32_t value = 0;
+            for(uint8_t b = 0; b < size; b++)
+                value |= static_cast<uint32_t>(bytes[i + b]) << (8 * b);
+            m.memory.store(address + i, size, value);
+        }
+    }
+
+    // Applies the chunks to m in file order. Only here do addresses and instruction
+    // indices become known: memoryPeak and the instruction count carry over chunk to chunk.
+    void applyAll(Machine& m, const std::vector<Chunk>& chunks){
+        size_t data = 0, lines = 0, labels = 0;
+        for(const Chunk& c : chunks)
+            for(const Item& item : c.items){
+                data += item.kind == Item::DATA;
+                lines += item.kind == Item::INSTRUCTION || item.kind == Item::LABEL;
+                labels += item.kind == Item::LABEL;
+            }
+        m.labels.reserve(m.labels.size() + data);
+        m.instructions.reserve(m.instructions.size() + lines);
+        m.instr_labels.reserve(m.instr_labels.size() + labels);
+
+        // --stats: .data lines count as data, everything else as text, minus writing output
+        double* phase = &m.stats.text;
+        Clock::time_point start = Clock::now();
+        double written = m.out.writeSeconds();
+        auto lap = [&](double* next){
+            Clock::time_point now = Clock::now();
+            *phase += std::chrono::duration<double>(now - start).count() - (m.out.writeSeconds() - written);
+            start = now;
+            written = m.out.writeSeconds();
+            phase = next;
+        };
+
+        for(const Chunk& c : chunks){
+            for(const Item& item : c.items){
+                if(m.stats.enabled && (item.kind == Item::DATA) != (phase == &m.stats.data))
+                    lap(item.kind == Item::DATA ? &m.stats.data : &m.stats.text);
+                switch(item.kind){
+                    case Item::ECHO:
+                        m.out << item.line << '\n';
+                        break;
+                    case Item::GLOBAL:
+                        m.currentLabel = item.label;
+                        m.out << item.line << '\n';
+                        break;
+                    case Item::DATA:
+                        m.out << item.line << '\n';
+                        m.labels[item.label] = {item.size, m.memoryPeak};
+                        layOut(m, m.memoryPeak, c.bytes.data() + item.first, item.count, item.size);
+                        m.memoryPeak += item.advance;
+                        break;
+                    case Item::LABEL:
+                        m.instr_labels[item.label] = static_cast<uint32_t>(m.instructions.size());
+                        m.instructions.push_back(item.line);
+                        break;
+                    case Item::INSTRUCTION:
+                        m.instructions.push_back(item.line);
+                        break;
+                    case Item::WARNING:
+                        *m.err << "Error: Could not parse value: " << item.line << std::endl;
+                        break;
+                    case Item::ERROR:
+                        if(m.stats.enabled) lap(phase);
+                        throw std::runtime_error(c.error);
+                }
+            }
+        }
+        if(m.stats.enabled) lap(phase);
+    }
+}
+
+void loadSource(Machine& m, std::istream& in){
+    m.source.own(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+    loadSource(m, m.source.view());
+}
+
+void loadSource(Machine& m, std::string_view text){
+    // Chunks end at line boundaries
+    const size_t count = std::max<size_t>(1, std::min<size_t>(m.threads, text.size() / MIN_CHUNK));
+    std::vector<Chunk> chunks(count);
+    size_t begin = 0;
+    for(size_t i = 0; i < count; i++){
+        size_t end = i + 1 == count ? text.size() : text.find('\n', std::max(begin, text.size() / count * (i + 1)));
+        end = end == std::string_view::npos ? text.size() : std::min(end + 1, text.size());
+        chunks[i].text = text.substr(begin, end - begin);
+        begin = end;
+    }
+
+    // Where each chunk starts: in the section the chunks before it left active
+    Clock::time_point start = Clock::now();
+    if(count > 1){
+        std::vector<Sections> last(count);
+        parallel(static_cast<unsigned>(count), [&](unsigned i){ last[i] = lastSection(chunks[i].text, NONE); });
+        for(size_t i = 1; i < count; i++)
+            chunks[i].section = last[i - 1] != NONE ? last[i - 1] : chunks[i - 1].section;
+    }
+    parallel(static_cast<unsigned>(count), [&](unsigned i){ read(chunks[i], m.stats.enabled); });
+
+    // --stats: the threads overlap, so their time is scaled down to the time that passed
+    if(m.stats.enabled){
+        double wall = std::chrono::duration<double>(Clock::now() - start).count();
+        double data = 0, code = 0;
+        for(const Chunk& c : chunks){
+            data += c.data;
+            code += c.code;
+        }
+        if(data + code > 0){
+            m.stats.data += wall * data / (data + code);
+            m.stats.text += wall * code / (data + code);
+        }
+    }
+    applyAll(m, chunks);
+}
@@ -0,0 +1,534 @@
+#include "LoopSummary.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include "Machine.hpp"
+
+using Form = LoopSummary::Form;
+using State = LoopSummary::State;
+using Operands::OperandSpec;
+using Operands::OperandType;
+
+namespace{
+    Form constant(uint32_t c){
+        Form f;
+        f.c = c;
+        return f;
+    }
+
+    Form plus(Form a, const Form& b){
+        for(size_t j = 0; j < a.coef.size(); j++) a.coef[j] += b.coef[j];
+        a.c += b.c;
+        return a;
+    }
+
+    Form times(Form a, uint32_t k){
+        for(uint32_t& x : a.coef) x *= k;
+        a.c *= k;
+        return a;
+    }
+
+    Form minus(const Form& a, const Form& b){ return plus(a, times(b, 0xFFFFFFFFu)); }
+
+    uint32_t eval(const Form& f, const State& s, size_t n){
+        uint32_t v = f.c;
+        for(size_t j = 0; j < n; j++) v += f.coef[j] * s[j];
+        return v;
+    }
+
+    uint32_t shifted(LoopSummary::Shift shift, uint32_t v, uint64_t by){
+        if(shift == LoopSummary::Shift::SAR)
+            return static_cast<uint32_t>(static_cast<int32_t>(v) >> (by < 31 ? by : 31));
+        return by < 32 ? v >> by : 0;
+    }
+
+    // One iteration
+    State step(const LoopSummary::Plan& plan, const State& s){
+        const size_t n = plan.slots.size();
+        State next{};
+        for(size_t j = 0; j < n; j++){
+            const LoopSummary::Slot& slot = plan.slots[j];
+            next[j] = slot.shift != LoopSummary::Shift::NONE ? shifted(slot.shift, s[j], slot.shiftBy)
+                                                              : eval(plan.next[j], s, n);
+        }
+        return next;
+    }
+
+    // Square matrices of size n, modulo 2^32
+    using Matrix = std::vector<uint32_t>;
+
+    Matrix multiply(const Matrix& x, const Matrix& y, size_t n){
+        Matrix r(n * n, 0);
+        for(size_t i = 0; i < n; i++)
+            for(size_t k = 0; k < n; k++){
+                uint32_t v = x[i * n + k];
+                if(!v) continue;
+                for(size_t j = 0; j < n; j++) r[i * n + j] += v * y[k * n + j];
+            }
+        return r;
+    }
+
+    // count iterations at once: S -> A^count * S + (A^(count-1) + ... + I) * b
+    State power(const LoopSummary::Plan& plan, const State& s, uint64_t count){
+        const size_t n = plan.slots.size(), size = n + 1;
+        Matrix base(size * size, 0), result(size * size, 0);
+        for(size_t j = 0; j < n; j++){
+            for(size_t k = 0; k < n; k++) base[j * size + k] = plan.next[j].coef[k];
+            base[j * size + n] = plan.next[j].c;
+        }
+        base[n * size + n] = 1;
+        for(size_t j = 0; j < size; j++) result[j * size + j] = 1;
+        for(; count; count >>= 1){
+            if(count & 1) result = multiply(result, base, size);
+            if(count > 1) base = multiply(base, base, size);
+        }
+
+        State next{};
+        for(size_t j = 0; j < n; j++){
+            uint32_t v = result[j * size + n];
+            for(size_t k = 0; k < n; k++) v += result[j * size + k] * s[k];
+            next[j] = v;
+        }
+        return next;
+    }
+
+    // Smallest k >= 0 with v + k * stride == w modulo 2^32, -1 when there is none
+    int64_t solveEqual(uint32_t v, uint32_t stride, uint32_t w){
+        uint32_t diff = w - v;
+        uint32_t zeros = 0;
+        while(!((stride >> zeros) & 1)) zeros++;
+        if(diff & ((uint32_t(1) << zeros) - 1)) return -1;
+        uint32_t odd = stride >> zeros, inverse = odd;
+        for(int i = 0; i < 4; i++) inverse *= 2 - odd * inverse; // Newton: 3, 6, 12, 24, 48 correct bits
+        uint64_t modulus = uint64_t(1) << (32 - zeros);
+        return static_cast<uint32_t>((diff >> zeros) * inverse) % modulus;
+    }
+
+    // a cond b is b mirror(cond) a
+    Flags::Cond mirror(Flags::Cond cond){
+        switch(cond){
+            case Flags::Cond::B: return Flags::Cond::A;
+            case Flags::Cond::A: return Flags::Cond::B;
+            case Flags::Cond::AE: return Flags::Cond::BE;
+            case Flags::Cond::BE: return Flags::Cond::AE;
+            case Flags::Cond::L: return Flags::Cond::G;
+            case Flags::Cond::G: return Flags::Cond::L;
+            case Flags::Cond::GE: return Flags::Cond::LE;
+            case Flags::Cond::LE: return Flags::Cond::GE;
+            default: return cond;
+        }
+    }
+
+    // Iterations of the loop still to run, the current one included, while the
+    // compared value goes v, v + stride, ... against w with cond; 0 when it is
+    // not a plain count (never ends, or wraps around before it does)
+    uint64_t countCompare(Flags::Cond cond, uint32_t v, uint32_t stride, uint32_t w){
+        using Flags::Cond;
+        if(cond == Cond::NE){
+            int64_t k = solveEqual(v, stride, w);
+            return k < 0 ? 0 : k + 1;
+        }
+        bool isSigned = cond == Cond::L || cond == Cond::GE || cond == Cond::LE || cond == Cond::G;
+        bool isUnsigned = cond == Cond::B || cond == Cond::AE || cond == Cond::BE || cond == Cond::A;
+        if(!isSigned && !isUnsigned) return 0;
+
+        int64_t value = isSigned ? int64_t(int32_t(v)) : int64_t(v);
+        int64_t limit = isSigned ? int64_t(int32_t(w)) : int64_t(w);
+        int64_t delta = int32_t(stride);
+        // Everything as "goes on while x < bound"
+        int64_t x = value, by = delta, bound = limit;
+        if(cond == Cond::LE || cond == Cond::BE) bound = limit + 1;
+        else if(cond == Cond::G || cond == Cond::A){
+            x = -value, by = -delta, bound = -limit;
+        }else if(cond == Cond::GE || cond == Cond::AE){
+            x = -value, by = -delta, bound = -limit + 1;
+        }
+        if(x >= bound) return 1;
+        if(by <= 0) return 0;
+        uint64_t trips = 1 + (bound - x + by - 1) / by;
+
+        // The value seen by the last compare must not have wrapped
+        int64_t last = value + int64_t(trips - 1) * delta;
+        int64_t low = isSigned ? INT32_MIN : 0, high = isSigned ? INT32_MAX : int64_t(UINT32_MAX);
+        return last < low || last > high ? 0 : trips;
+    }
+}
+
+void LoopSummary::reset(){
+    planOf.clear();
+    plans.clear();
+    dataLabels.clear();
+    texts.clear();
+}
+
+bool LoopSummary::fastForward(Machine& m, uint32_t branch, uint64_t budget){
+    if(planOf.size() != m.program.size()) planOf.assign(m.program.size(), UNKNOWN);
+    int32_t& id = planOf[branch];
+    if(id == REJECTED) return false;
+    if(id == UNKNOWN){
+        Plan plan;
+        if(!analyze(m, branch, plan)){
+            id = REJECTED;
+            return false;
+        }
+        id = static_cast<int32_t>(plans.size());
+        plans.push_back(std::move(plan));
+    }
+
+    Plan& plan = plans[id];
+    if(!skip(m, plan, budget)){
+        if(++plan.misses == MAX_MISSES) id = REJECTED;
+        return false;
+    }
+    plan.misses = 0;
+    return true;
+}
+
+bool LoopSummary::analyze(const Machine& m, uint32_t branch, Plan& plan){
+    using Instr::Type;
+    const Instr::Instruction& back = m.program[branch];
+    const uint32_t head = back.target;
+    if(head > branch || branch - head >= MAX_BODY) return false;
+    if(back.type != Type::JCC && back.type != Type::LOOP) return false;
+    plan.head = head;
+    plan.length = branch - head + 1;
+
+    // Slots are numbered as the loop first uses them; cur[j] is slot j's value so
+    // far in the iteration, in terms of the values at its start
+    std::array<Form, MAX_SLOTS>& cur = plan.next;
+    auto add = [&](Registers::Reg reg, uint32_t address) -> int{
+        if(plan.slots.size() == MAX_SLOTS) return -1;
+        size_t j = plan.slots.size();
+        plan.slots.push_back({.reg = reg, .address = address});
+        cur[j] = Form{};
+        cur[j].coef[j] = 1;
+        return static_cast<int>(j);
+    };
+    auto registerSlot = [&](Registers::Reg reg) -> int{
+        using namespace Registers;
+        if(reg != EAX && reg != EBX && reg != ECX && reg != EDX && reg != ESI && reg != EDI && reg != EBP)
+            return -1;
+        for(size_t j = 0; j < plan.slots.size(); j++)
+            if(plan.slots[j].reg == reg) return static_cast<int>(j);
+        return add(reg, 0);
+    };
+    auto memorySlot = [&](uint32_t address) -> int{
+        if(uint64_t(address) + 4 > m.memorySize) return -1;
+        for(size_t j = 0; j < plan.slots.size(); j++){
+            const Slot& s = plan.slots[j];
+            if(s.reg != Registers::COUNT) continue;
+            if(s.address == address) return static_cast<int>(j);
+            if(address - s.address + 3 < 7) return -1; // words overlapping in part
+        }
+        return add(Registers::COUNT, address);
+    };
+    auto fixed = [](const OperandSpec& op){ return op.base == Registers::COUNT && op.index == Registers::COUNT; };
+    auto slotOf = [&](const OperandSpec& op) -> int{
+        if(op.type == OperandType::REGISTER) return registerSlot(op.regTag);
+        if(op.type == OperandType::ADDRESS && fixed(op)) return memorySlot(static_cast<uint32_t>(op.imm));
+        return -1;
+    };
+    auto read = [&](const OperandSpec& op, Form& f){
+        if(op.type == OperandType::IMMEDIATE){
+            f = constant(static_cast<uint32_t>(op.imm));
+            return true;
+        }
+        int j = slotOf(op);
+        if(j < 0 || plan.slots[j].shift != Shift::NONE) return false;
+        f = cur[j];
+        return true;
+    };
+    auto write = [&](const OperandSpec& op, const Form& f){
+        int j = slotOf(op);
+        if(j < 0 || plan.slots[j].shift != Shift::NONE) return false;
+        cur[j] = f;
+        plan.slots[j].written = true;
+        return true;
+    };
+    auto addressOf = [&](const OperandSpec& op, Form& f){
+        f = constant(static_cast<uint32_t>(op.imm));
+        Form r;
+        if(op.base != Registers::COUNT){
+            if(!read({.type = OperandType::REGISTER, .regTag = op.base}, r)) return false;
+            f = plus(f, r);
+        }
+        if(op.index != Registers::COUNT){
+            if(!read({.type = OperandType::REGISTER, .regTag = op.index}, r)) return false;
+            f = plus(f, times(r, op.scale));
+        }
+        return true;
+    };
+
+    // The last instruction that set the flags: what the branch compares
+    enum class Setter{ NONE, COMPARE, DEC, ZERO, SHIFT } setter = Setter::NONE;
+    Form fa, fb;
+    int shiftSlot = -1;
+
+    for(uint32_t i = head; i < branch; i++){
+        const Instr::Instruction& in = m.program[i];
+        if(in.type == Type::LABEL) continue;
+        if(in.size != 4) return false;
+        Form s, d, r;
+        switch(in.type){
+            case Type::MOV:
+                if(!read(in.src, s)) return false;
+                if(in.dest.type == OperandType::ADDRESS && !fixed(in.dest)){
+                    Form address;
+                    if(!addressOf(in.dest, address)) return false;
+                    plan.fills.push_back({address, s});
+                }else if(!write(in.dest, s)) return false;
+                break;
+            case Type::ADD:
+            case Type::SUB:
+            case Type::CMP:
+                if(!read(in.src, s) || !read(in.dest, d)) return false;
+                if(in.type == Type::ADD){
+                    r = plus(d, s);
+                    setter = Setter::ZERO, fa = r, fb = Form{};
+                }else{
+                    r = minus(d, s);
+                    setter = Setter::COMPARE, fa = d, fb = s;
+                }
+                if(in.type != Type::CMP && !write(in.dest, r)) return false;
+                break;
+            case Type::INC:
+            case Type::DEC:
+                if(!read(in.src, d)) return false;
+                r = plus(d, constant(in.type == Type::INC ? 1 : 0xFFFFFFFFu));
+                if(!write(in.src, r)) return false;
+                if(in.type == Type::INC) setter = Setter::ZERO, fa = r, fb = Form{};
+                else setter = Setter::DEC, fa = d, fb = constant(1);
+                break;
+            case Type::LEA:
+                if(in.src.type != OperandType::ADDRESS || !addressOf(in.src, s) || !write(in.dest, s)) return false;
+                break;
+            case Type::SHL:{
+                if(in.src.type != OperandType::IMMEDIATE || !read(in.dest, d)) return false;
+                uint32_t count = in.src.imm & 31;
+                r = times(d, uint32_t(1) << count);
+                if(!write(in.dest, r)) return false;
+                if(count) setter = Setter::ZERO, fa = r, fb = Form{};
+                break;
+            }
+            case Type::SHR:
+            case Type::SAR:{
+                if(in.src.type != OperandType::IMMEDIATE || in.dest.type != OperandType::REGISTER) return false;
+                uint32_t count = in.src.imm & 31;
+                if(!count) break;
+                int j = registerSlot(in.dest.regTag);
+                if(j < 0 || plan.slots[j].written || plan.slots[j].shift != Shift::NONE) return false;
+                plan.slots[j].shift = in.type == Type::SHR ? Shift::SHR : Shift::SAR;
+                plan.slots[j].shiftBy = count;
+                setter = Setter::SHIFT, shiftSlot = j;
+                break;
+            }
+            case Type::XOR:
+                // xorl %eax, %eax: only the zeroing idiom is linear
+                if(in.src.type != OperandType::REGISTER || in.dest.type != OperandType::REGISTER ||
+                   in.src.regTag != in.dest.regTag || !write(in.dest, Form{}))
+                    return false;
+                setter = Setter::ZERO, fa = fb = Form{};
+                break;
+            case Type::TEST:{
+                if(in.src.type != OperandType::REGISTER || in.dest.type != OperandType::REGISTER ||
+                   in.src.regTag != in.dest.regTag)
+                    return false;
+                // test r, r leaves the same flags as cmp $0, r; on a shifted register it only tells 0 apart
+                int j = registerSlot(in.dest.regTag);
+                if(j >= 0 && plan.slots[j].shift != Shift::NONE){
+                    setter = Setter::SHIFT, shiftSlot = j;
+                    break;
+                }
+                if(!read(in.dest, d)) return false;
+                setter = Setter::COMPARE, fa = d, fb = Form{};
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    using Flags::Cond;
+    if(back.type == Type::LOOP){
+        int j = registerSlot(Registers::ECX);
+        if(j < 0 || plan.slots[j].shift != Shift::NONE) return false;
+        cur[j] = plus(cur[j], constant(0xFFFFFFFFu));
+        plan.slots[j].written = true;
+        plan.a = cur[j];
+        plan.b = Form{};
+        plan.cond = Cond::NE;
+    }else{
+        Cond cond = back.cond;
+        bool ordered = cond == Cond::L || cond == Cond::GE || cond == Cond::LE || cond == Cond::G;
+        bool unordered = cond == Cond::B || cond == Cond::AE || cond == Cond::BE || cond == Cond::A;
+        bool equality = cond == Cond::E || cond == Cond::NE;
+        switch(setter){
+            case Setter::COMPARE: if(!ordered && !unordered && !equality) return false; break;
+            case Setter::DEC: if(!ordered && !equality) return false; break; // dec keeps CF
+            case Setter::ZERO:
+            case Setter::SHIFT: if(!equality) return false; break;
+            default: return false;
+        }
+        plan.a = fa;
+        plan.b = fb;
+        plan.cond = cond;
+        if(setter == Setter::SHIFT) plan.shifted = shiftSlot;
+    }
+
+    const size_t n = plan.slots.size();
+    // Shifted registers feed nothing but the exit test
+    for(size_t j = 0; j < n; j++){
+        if(plan.slots[j].shift == Shift::NONE) continue;
+        auto uses = [j](const Form& f){ return f.coef[j] != 0; };
+        for(size_t k = 0; k < n; k++)
+            if(k != j && uses(cur[k])) return false;
+        for(const Fill& f : plan.fills)
+            if(uses(f.address) || uses(f.value)) return false;
+        if(plan.shifted < 0 && (uses(plan.a) || uses(plan.b))) return false;
+    }
+    // Compared values and store addresses move by the same amount every iteration:
+    // what they depend on either stays or itself moves by a constant
+    auto constantStride = [&](const Form& f){
+        for(size_t k = 0; k < n; k++){
+            uint32_t change = 0;
+            for(size_t j = 0; j < n; j++) change += f.coef[j] * (cur[j].coef[k] - (j == k));
+            if(change && (plan.slots[k].written || plan.slots[k].shift != Shift::NONE)) return false;
+        }
+        return true;
+    };
+    if(plan.shifted < 0 && (!constantStride(plan.a) || !constantStride(plan.b))) return false;
+    for(const Fill& f : plan.fills)
+        if(!constantStride(f.address)) return false;
+
+    for(Slot& slot : plan.slots){
+        if(slot.reg == Registers::COUNT) slot.tail = ", " + addressText(m, slot.address) + "\n";
+        else for(const auto& [name, reg] : Registers::stringToTag)
+            if(reg == slot.reg) slot.tail = ", " + std::string(name) + "\n";
+    }
+    return true;
+}
+
+bool LoopSummary::skip(Machine& m, Plan& plan, uint64_t budget){
+    const size_t n = plan.slots.size();
+    State s{};
+    for(size_t j = 0; j < n; j++){
+        const Slot& slot = plan.slots[j];
+        s[j] = slot.reg != Registers::COUNT ? static_cast<uint32_t>(m.regs.*Registers::regData[slot.reg].base_register)
+                                            : m.memory.load(slot.address, 4);
+    }
+    const State second = step(plan, s);
+
+    // Iterations left, this one included
+    uint64_t trips;
+    uint32_t a = 0, b = 0, strideA = 0, strideB = 0;
+    if(plan.shifted >= 0){
+        const Slot& slot = plan.slots[plan.shifted];
+        uint32_t v = s[plan.shifted];
+        if(plan.cond != Flags::Cond::NE || (slot.shift == Shift::SAR && static_cast<int32_t>(v) < 0)) return false;
+        uint32_t bits = 0;
+        while(bits < 32 && v >> bits) bits++;
+        trips = std::max<uint64_t>(1, (bits + slot.shiftBy - 1) / slot.shiftBy);
+    }else{
+        a = eval(plan.a, s, n), b = eval(plan.b, s, n);
+        strideA = eval(plan.a, second, n) - a, strideB = eval(plan.b, second, n) - b;
+        if(strideB == 0 && strideA != 0) trips = countCompare(plan.cond, a, strideA, b);
+        else if(strideA == 0 && strideB != 0) trips = countCompare(mirror(plan.cond), b, strideB, a);
+        else return false;
+    }
+    if(trips < 3) return false;
+    if(plan.shifted < 0){
+        // The flags the branch sees: taken before the last iteration, not on it
+        auto jumps = [&](uint64_t iteration){
+            uint32_t x = a + uint32_t(iteration - 1) * strideA, y = b + uint32_t(iteration - 1) * strideB;
+            Flags::Lazy flags;
+            flags.set(Flags::Op::SUB, 4, x, y, x - y);
+            return flags.test(plan.cond);
+        };
+        if(jumps(trips) || !jumps(trips - 1)) return false;
+    }
+    const uint64_t count = trips - 1;
+    if(count * plan.length >= budget) return false;
+
+    State last;
+    // Where the stores through an index land, in address order per store
+    struct Range{ uint32_t first; int32_t stride; };
+    std::vector<Range> ranges;
+    if(plan.fills.empty()){
+        last = power(plan, s, count);
+        for(size_t j = 0; j < n; j++)
+            if(plan.slots[j].shift != Shift::NONE)
+                last[j] = shifted(plan.slots[j].shift, s[j], count * plan.slots[j].shiftBy);
+    }else{
+        if(count > MAX_FILL) return false;
+        for(const Fill& f : plan.fills){
+            uint32_t first = eval(f.address, s, n);
+            int32_t stride = static_cast<int32_t>(eval(f.address, second, n) - first);
+            int64_t end = int64_t(first) + int64_t(count - 1) * stride;
+            int64_t low = std::min<int64_t>(first, end), high = std::max<int64_t>(first, end) + 4;
+            if(low < 0 || uint64_t(high) > m.memorySize) return false;
+            for(const Slot& slot : plan.slots)
+                if(slot.reg == Registers::COUNT && slot.address < high && low < int64_t(slot.address) + 4) return false;
+            ranges.push_back({first, stride});
+        }
+        last = s;
+        for(uint64_t i = 0; i < count; i++){
+            for(const Fill& f : plan.fills) m.memory.store(eval(f.address, last, n), 4, eval(f.value, last, n));
+            last = step(plan, last);
+        }
+    }
+
+    m.executed += count * plan.length;
+
+    // The net effect, as the moves a full run would have ended with
+    for(size_t r = 0; r < ranges.size(); r++){
+        uint64_t cells = ranges[r].stride ? count : 1;
+        for(uint64_t i = 0; i < cells; i++){
+            uint32_t address = ranges[r].first + uint32_t(i) * uint32_t(ranges[r].stride);
+            std::string tail = ", " + addressText(m, address) + "\n";
+            std::string_view view = tail;
+            if(m.tracing()) view = texts.emplace_back(std::move(tail)); // the trace keeps views
+            emit(m, plan, m.memory.load(address, 4), view, 0, Trace::REMOVABLE | Trace::STORE, address);
+        }
+    }
+    for(size_t j = 0; j < n; j++){
+        Slot& slot = plan.slots[j];
+        if(!slot.written && slot.shift == Shift::NONE) continue;
+        if(slot.reg != Registers::COUNT){
+            m.regs.*Registers::regData[slot.reg].base_register = static_cast<int32_t>(last[j]);
+            emit(m, plan, last[j], slot.tail, Registers::lanes(slot.reg), Trace::REMOVABLE, 0);
+        }else{
+            m.memory.store(slot.address, 4, last[j]);
+            emit(m, plan, last[j], slot.tail, 0, Trace::REMOVABLE | Trace::STORE, slot.address);
+        }
+    }
+    return true;
+}
+
+// label, label+offset or the bare address when no .data label is below it
+std::string LoopSummary::addressText(const Machine& m, uint32_t address){
+    if(dataLabels.empty()){
+        for(const auto& [name, label] : m.labels) dataLabels.push_back({label.address, name});
+        std::sort(dataLabels.begin(), dataLabels.end(),
+                  [](const auto& x, const auto& y){ return x.first != y.first ? x.first < y.first : x.second < y.second; });
+    }
+    auto it = std::upper_bound(dataLabels.begin(), dataLabels.end(), address,
+                               [](uint32_t a, const auto& label){ return a < label.first; });
+    if(it == dataLabels.begin()) return std::to_string(address);
+    --it;
+    while(it != dataLabels.begin() && std::prev(it)->first == it->first) --it;
+    if(it->first == address) return std::string(it->second);
+    return std::string(it->second) + "+" + std::to_string(address - it->first);
+}
+
+void LoopSummary::emit(Machine& m, const Plan& plan, uint32_t value, std::string_view tail,
+                       uint32_t writes, uint8_t flags, uint32_t address){
+    const int64_t signedValue = static_cast<int32_t>(value);
+    if(m.tracing()){
+        m.trace({&m.program[plan.head], "movl $", tail, signedValue, 4, flags, 0, writes, address});
+        return;
+    }
+    m.out.put("movl $");
+    m.out.putInt(signedValue);
+    m.out.put(tail);
+}
@@ -0,0 +1,49 @@
+#include "Memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Mem{
+    const uint8_t PagedMemory::zeroPage[PAGE_SIZE] = {};
+
+    void PagedMemory::reset(uint64_t newSize){
+        for(uint32_t page : touched){
+            freePages.push_back(std::move(owned[page]));
+            readPages[page] = zeroPage;
+        }
+        touched.clear();
+
+        if(newSize != memSize){
+            memSize = newSize;
+            size_t count = static_cast<size_t>((newSize + PAGE_SIZE - 1) >> PAGE_BITS);
+            readPages.assign(count, zeroPage);
+            owned.clear();
+            owned.resize(count);
+        }
+    }
+
+    void PagedMemory::write(uint32_t addr, const uint8_t* bytes, size_t length){
+        check(addr, length);
+        while(length){
+            uint32_t offset = addr & (PAGE_SIZE - 1);
+            size_t part = std::min<size_t>(length, PAGE_SIZE - offset);
+            std::memcpy(writablePage(addr >> PAGE_BITS) + offset, bytes, part);
+            addr += static_cast<uint32_t>(part);
+            bytes += part;
+            length -= part;
+        }
+    }
+
+    uint8_t* PagedMemory::allocatePage(uint32_t page){
+        if(!freePages.empty()){
+            owned[page] = std::move(freePages.back());
+            freePages.pop_back();
+            std::memset(owned[page].get(), 0, PAGE_SIZE);
+        }else{
+            owned[page] = std::make_unique<uint8_t[]>(PAGE_SIZE);
+        }
+        readPages[page] = owned[page].get();
+        touched.push_back(page);
+        return owned[page].get();
+    }
+}
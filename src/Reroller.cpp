@@ -0,0 +1,167 @@
+#include "Reroller.hpp"
+
+#include <utility>
+
+namespace{
+    bool sameShape(const TraceLine& a, const TraceLine& b){
+        return a.source == b.source && a.tail.data() == b.tail.data();
+    }
+
+    // addX $step has to encode the step in the operand size
+    bool fits(int64_t step, uint8_t size){
+        if(size == 1) return step >= -128 && step <= 255;
+        if(size == 2) return step >= -32768 && step <= 65535;
+        return step >= INT32_MIN && step <= INT32_MAX;
+    }
+
+    char suffix(uint8_t size){
+        return size == 4 ? 'l' : size == 2 ? 'w' : 'b';
+    }
+}
+
+void Reroller::reset(){
+    pending.clear();
+    run.fill(0);
+    period = 0;
+    repeats = 0;
+    body.clear();
+    step.clear();
+    last.clear();
+    partial.clear();
+    loops = 0;
+}
+
+void Reroller::push(const TraceLine& line){
+    if(!enabled){
+        emit(line, line.value);
+        return;
+    }
+    if(period){
+        size_t pos = partial.size();
+        if(sameShape(line, body[pos]) && (collapse || !line.size || line.value == last[pos] + step[pos])){
+            partial.push_back(line);
+            if(partial.size() == period){
+                for(size_t i = 0; i < period; i++) last[i] = partial[i].value;
+                partial.clear();
+                repeats++;
+            }
+            return;
+        }
+        // The unfinished iteration goes back through detection
+        std::vector<TraceLine> rest = std::move(partial);
+        endLoop();
+        for(const TraceLine& l : rest) push(l);
+        push(line);
+        return;
+    }
+
+    pending.push_back(line);
+    size_t n = pending.size() - 1;
+    for(size_t p = 1; p <= MAX_PERIOD && p <= n; p++){
+        run[p] = sameShape(line, pending[n - p]) ? run[p] + 1 : 0;
+        // Tried once per iteration, the values may only settle into steps later
+        if(run[p] >= (MIN_REPEATS - 1) * p && run[p] % p == 0 && startLoop(p)) return;
+    }
+
+    if(pending.size() > WINDOW){
+        emit(pending.front(), pending.front().value);
+        pending.pop_front();
+    }
+}
+
+// The last MIN_REPEATS * length pending lines are iterations of a loop; starts it if it can be written back
+bool Reroller::startLoop(size_t length){
+    size_t first = pending.size() - MIN_REPEATS * length;
+    size_t latest = pending.size() - length;
+
+    // Only constants loaded into registers: earlier iterations are overwritten unread,
+    // whatever the values are
+    bool pure = true, clobbers = false;
+    for(size_t i = first; i < first + length; i++){
+        pure &= pending[i].size && pending[i].writes && !pending[i].reads;
+        clobbers |= pending[i].flags & Trace::BARRIER;
+    }
+
+    for(size_t i = 0; i < length && !pure; i++){
+        const TraceLine& line = pending[first + i];
+        if(!line.size) continue;
+        int64_t s = pending[first + length + i].value - line.value;
+        for(size_t k = first + i + length; k < pending.size(); k += length)
+            if(pending[k].value - pending[k - length].value != s) return false;
+        if(s == 0) continue;
+        // A moving constant becomes addX $step, %reg: the register must hold
+        // the previous iteration's value, so nothing else may write it
+        if(clobbers || !line.writes || !fits(s, line.size)) return false;
+        for(size_t j = 0; j < length; j++)
+            if(j != i && (pending[first + j].writes & line.writes)) return false;
+    }
+
+    for(size_t i = 0; i < first; i++) emit(pending[i], pending[i].value);
+
+    period = length;
+    repeats = MIN_REPEATS;
+    collapse = pure;
+    body.assign(pending.begin() + first, pending.begin() + first + length);
+    step.resize(length);
+    last.resize(length);
+    for(size_t i = 0; i < length; i++){
+        step[i] = body[i].size ? pending[first + length + i].value - body[i].value : 0;
+        last[i] = pending[latest + i].value;
+    }
+    partial.clear();
+    pending.clear();
+    run.fill(0);
+    return true;
+}
+
+void Reroller::endLoop(){
+    if(collapse){
+        for(size_t i = 0; i < period; i++) emit(body[i], last[i]);
+    }else{
+        for(const TraceLine& line : body) emit(line, line.value);
+
+        if(loops == 0) out << ".data\n.Lreroll_count: .long 0\n.text\n";
+        uint32_t label = loops++;
+        out << "movl $";
+        out.putInt(static_cast<int64_t>(repeats - 1));
+        out << ", .Lreroll_count\n.Lreroll";
+        out.putInt(label);
+        out << ":\n";
+        for(size_t i = 0; i < period; i++){
+            const TraceLine& line = body[i];
+            if(step[i] == 0){
+                emit(line, line.value);
+                continue;
+            }
+            // tail is ", %reg\n"
+            out << "add" << suffix(line.size) << " $";
+            out.putInt(step[i]);
+            out << line.tail;
+        }
+        out << "decl .Lreroll_count\njnz .Lreroll";
+        out.putInt(label);
+        out << '\n';
+    }
+
+    period = 0;
+    repeats = 0;
+    body.clear();
+    partial.clear();
+}
+
+void Reroller::finish(){
+    while(period){
+        std::vector<TraceLine> rest = std::move(partial);
+        endLoop();
+        for(const TraceLine& l : rest) push(l);
+    }
+    for(const TraceLine& line : pending) emit(line, line.value);
+    pending.clear();
+    run.fill(0);
+}
+
+void Reroller::emit(const TraceLine& line, int64_t value){
+    out.put(line.head);
+    if(line.size) out.putInt(value);
+    out.put(line.tail);
+}
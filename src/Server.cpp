@@ -0,0 +1,349 @@
+#include "Server.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if UNIX_SOCKETS
+    #include <cerrno>
+    #include <csignal>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+#if UNIX_SOCKETS
+namespace{
+    volatile std::sig_atomic_t stopping = 0;
+
+    void stop(int){
+        stopping = 1;
+    }
+
+#ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL; // a peer that hung up is a failed write, not SIGPIPE
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+    constexpr int POLL_MS = 250; // how soon a blocked read or accept notices stopping
+
+    bool address(const std::string& path, sockaddr_un& addr, std::string& problem){
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(addr.sun_path)){
+            problem = "socket path too long: " + path;
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // Reads and writes whole messages on a socket. Reads give up when the
+    // peer closes, on an error, or (on the server) once stopping is set.
+    class Connection{
+    public:
+        Connection(int fd, std::string& pending, bool server) : fd(fd), pending(pending), server(server){}
+
+        bool writeAll(const char* data, size_t size){
+            while(size){
+                ssize_t n = ::send(fd, data, size, SEND_FLAGS);
+                if(n < 0 && errno == EINTR) continue;
+                if(n <= 0) return false;
+                data += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+        bool writeAll(std::string_view str){ return writeAll(str.data(), str.size()); }
+
+        // One line without its '\n'; lines longer than limit are an error
+        bool readLine(std::string& line, size_t limit = 256){
+            for(size_t scanned = 0;;){
+                size_t end = pending.find('\n', scanned);
+                if(end != std::string::npos){
+                    line.assign(pending, 0, end);
+                    pending.erase(0, end + 1);
+                    return true;
+                }
+                scanned = pending.size();
+                if(scanned > limit || !fill()) return false;
+            }
+        }
+
+        // n bytes, handed to take(data, size) as they arrive
+        template<typename Take>
+        bool readBytes(size_t n, Take&& take){
+            while(n){
+                if(pending.empty() && !fill()) return false;
+                size_t part = std::min(n, pending.size());
+                take(pending.data(), part);
+                pending.erase(0, part);
+                n -= part;
+            }
+            return true;
+        }
+
+    private:
+        bool fill(){
+            char block[1 << 16];
+            for(;;){
+                if(server){
+                    if(stopping) return false;
+                    pollfd p = {.fd = fd, .events = POLLIN, .revents = 0};
+                    int ready = poll(&p, 1, POLL_MS);
+                    if(ready < 0 && errno != EINTR) return false;
+                    if(ready <= 0) continue;
+                }
+                ssize_t n = ::read(fd, block, sizeof(block));
+                if(n < 0 && errno == EINTR) continue;
+                if(n <= 0) return false;
+                pending.append(block, static_cast<size_t>(n));
+                return true;
+            }
+        }
+
+        int fd;
+        std::string& pending;
+        bool server;
+    };
+
+    // "word n1 n2 ...": false when the line has another word or a bad number
+    bool header(std::string_view line, std::string_view word, std::initializer_list<uint64_t*> numbers){
+        if(line.substr(0, word.size()) != word) return false;
+        line.remove_prefix(word.size());
+        for(uint64_t* number : numbers){
+            if(line.empty() || line[0] != ' ') return false;
+            line.remove_prefix(1);
+            auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), *number);
+            if(ec != std::errc()) return false;
+            line.remove_prefix(static_cast<size_t>(end - line.data()));
+        }
+        return line.empty();
+    }
+
+    // Output frames straight to the client; after a failed write the rest is dropped
+    class SocketSink : public MovFuscator::Sink{
+    public:
+        explicit SocketSink(Connection& connection) : connection(connection){}
+
+        void write(const char* data, size_t size) override{
+            if(broken) return;
+            char head[32];
+            char* end = std::to_chars(head + 4, head + sizeof(head), size).ptr;
+            std::memcpy(head, "out ", 4);
+            *end++ = '\n';
+            broken = !connection.writeAll(head, static_cast<size_t>(end - head)) || !connection.writeAll(data, size);
+        }
+
+        bool broken = false;
+
+    private:
+        Connection& connection;
+    };
+
+    // Answers the requests of one client until it hangs up
+    void handle(int fd, MovFuscator::Converter& converter){
+        std::string pending, line, source;
+        Connection connection(fd, pending, true);
+        while(connection.readLine(line)){
+            uint64_t length = 0;
+            if(!header(line, "convert", {&length}) || length > Server::MAX_SOURCE){
+                connection.writeAll("bad request\n");
+                return;
+            }
+            source.clear();
+            source.reserve(length);
+            if(!connection.readBytes(length, [&](const char* data, size_t size){ source.append(data, size); }))
+                return;
+
+            SocketSink sink(connection);
+            MovFuscator::Result result = converter.convert(source, sink);
+            if(sink.broken) return;
+            std::string done = "done " + std::to_string(result.executed) + ' ' + std::to_string(result.diagnostics.size())
+                             + ' ' + std::to_string(result.error.size()) + '\n';
+            if(!connection.writeAll(done) || !connection.writeAll(result.diagnostics) || !connection.writeAll(result.error))
+                return;
+        }
+    }
+}
+#endif
+
+namespace Server{
+    int serve(const std::string& path, const MovFuscator::Options& options, unsigned converters, std::ostream& log){
+#if UNIX_SOCKETS
+        sockaddr_un addr;
+        std::string problem;
+        if(!address(path, addr, problem)){
+            std::cerr << problem << '\n';
+            return 1;
+        }
+
+        // A socket file nobody answers on is left over from a server that died
+        Client probe;
+        if(probe.connect(path)){
+            std::cerr << "A server already listens on " << path << '\n';
+            return 1;
+        }
+        struct stat existing;
+        if(::lstat(path.c_str(), &existing) == 0){
+            if(!S_ISSOCK(existing.st_mode)){
+                std::cerr << path << " exists and is not a socket\n";
+                return 1;
+            }
+            ::unlink(path.c_str());
+        }
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+           || ::listen(listener, 64) < 0){
+            std::cerr << "Can't listen on " << path << ": " << std::strerror(errno) << '\n';
+            if(listener >= 0) ::close(listener);
+            return 1;
+        }
+
+        stopping = 0;
+        std::signal(SIGINT, stop);
+        std::signal(SIGTERM, stop);
+        std::signal(SIGPIPE, SIG_IGN); // a client that hangs up is a failed write, not the end of the server
+
+        // Clients wait here for a converter; each worker keeps its converter warm
+        std::deque<int> waiting;
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool closing = false;
+
+        converters = std::max(1u, converters);
+        std::vector<std::thread> workers;
+        for(unsigned i = 0; i < converters; i++)
+            workers.emplace_back([&]{
+                MovFuscator::Converter converter(options);
+                for(;;){
+                    int client;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready.wait(lock, [&]{ return closing || !waiting.empty(); });
+                        if(waiting.empty()) return;
+                        client = waiting.front();
+                        waiting.pop_front();
+                    }
+                    handle(client, converter);
+                    ::close(client);
+                }
+            });
+
+        log << "Serving on " << path << " with " << converters << (converters == 1 ? " converter" : " converters") << std::endl;
+        while(!stopping){
+            pollfd p = {.fd = listener, .events = POLLIN, .revents = 0};
+            if(poll(&p, 1, POLL_MS) <= 0) continue;
+            int client = ::accept(listener, nullptr, nullptr);
+            if(client < 0) continue;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                waiting.push_back(client);
+            }
+            ready.notify_one();
+        }
+
+        ::close(listener);
+        ::unlink(path.c_str());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+            for(int client : waiting) ::close(client);
+            waiting.clear();
+        }
+        ready.notify_all();
+        for(std::thread& t : workers)
+            t.join();
+        log << "Stopped" << std::endl;
+        return 0;
+#else
+        (void)path;
+        (void)options;
+        (void)converters;
+        (void)log;
+        std::cerr << "--serve needs Unix domain sockets, not available in this build\n";
+        return 1;
+#endif
+    }
+
+    Client::~Client(){
+#if UNIX_SOCKETS
+        if(fd >= 0) ::close(fd);
+#endif
+    }
+
+    bool Client::connect(const std::string& path){
+#if UNIX_SOCKETS
+        sockaddr_un addr;
+        if(!address(path, addr, problem)) return false;
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0){
+            problem = "Can't connect to " + path + ": " + std::strerror(errno);
+            if(fd >= 0) ::close(fd);
+            fd = -1;
+            return false;
+        }
+        return true;
+#else
+        (void)path;
+        problem = "Unix domain sockets are not available in this build";
+        return false;
+#endif
+    }
+
+    bool Client::convert(std::string_view source, MovFuscator::Sink& out, MovFuscator::Result& result){
+#if UNIX_SOCKETS
+        if(fd < 0){
+            problem = "Not connected";
+            return false;
+        }
+        Connection connection(fd, pending, false);
+        if(!connection.writeAll("convert " + std::to_string(source.size()) + '\n') || !connection.writeAll(source)){
+            problem = "Connection lost while sending";
+            return false;
+        }
+
+        std::string line;
+        uint64_t bytes = 0;
+        for(;;){
+            if(!connection.readLine(line)){
+                problem = "Connection lost while converting";
+                return false;
+            }
+            uint64_t length, executed, diagnostics, error;
+            if(header(line, "out", {&length})){
+                bytes += length;
+                if(!connection.readBytes(length, [&](const char* data, size_t size){ out.write(data, size); })) break;
+            }else if(header(line, "done", {&executed, &diagnostics, &error})){
+                result = {.decoded = false, .executed = executed, .bytes = bytes};
+                auto append = [](std::string& to){ return [&to](const char* data, size_t size){ to.append(data, size); }; };
+                if(!connection.readBytes(diagnostics, append(result.diagnostics))
+                   || !connection.readBytes(error, append(result.error))) break;
+                return true;
+            }else{
+                problem = "Unexpected answer: " + line;
+                return false;
+            }
+        }
+        problem = "Connection lost while converting";
+        return false;
+#else
+        (void)source;
+        (void)out;
+        (void)result;
+        problem = "Unix domain sockets are not available in this build";
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,107 @@
+#include "Source.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#if MAPPED_SOURCE
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace Source{
+    Text::Text(Text&& other) noexcept{
+        *this = std::move(other);
+    }
+
+    Text& Text::operator=(Text&& other) noexcept{
+        if(this == &other) return *this;
+        close();
+        mapped = other.mapped;
+        length = other.length;
+        if(mapped){
+            data = other.data;
+        }else{
+            owned = std::move(other.owned);
+            data = owned.data();
+        }
+        other.data = nullptr;
+        other.length = 0;
+        other.mapped = false;
+        other.owned.clear();
+        return *this;
+    }
+
+    bool Text::open(const std::string& path){
+        close();
+#if MAPPED_SOURCE
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        bool done = map(fd);
+        ::close(fd);
+        if(done) return true;
+        // Pipes, devices, a failed map: read it
+#endif
+        std::ifstream in(path, std::ios::binary);
+        if(!in) return false;
+        own(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+        return true;
+    }
+
+    bool Text::openStdin(){
+        close();
+#if MAPPED_SOURCE
+        // Redirected from a file (< x.s) and not read yet: mapped like any other
+        if(::lseek(STDIN_FILENO, 0, SEEK_CUR) == 0 && map(STDIN_FILENO)) return true;
+        std::string text;
+        char block[1 << 16];
+        for(;;){
+            ssize_t n = ::read(STDIN_FILENO, block, sizeof(block));
+            if(n < 0 && errno == EINTR) continue;
+            if(n < 0) return false;
+            if(n == 0) break;
+            text.append(block, static_cast<size_t>(n));
+        }
+        own(std::move(text));
+#else
+        own(std::string(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>()));
+#endif
+        return true;
+    }
+
+#if MAPPED_SOURCE
+    bool Text::map(int fd){
+        struct stat info;
+        if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return false;
+        if(info.st_size == 0) return true;
+        void* memory = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(memory == MAP_FAILED) return false;
+        madvise(memory, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        data = static_cast<const char*>(memory);
+        length = static_cast<size_t>(info.st_size);
+        mapped = true;
+        return true;
+    }
+#endif
+
+    void Text::own(std::string text){
+        close();
+        owned = std::move(text);
+        data = owned.data();
+        length = owned.size();
+    }
+
+    void Text::close(){
+#if MAPPED_SOURCE
+        if(mapped) munmap(const_cast<char*>(data), length);
+#endif
+        mapped = false;
+        data = nullptr;
+        length = 0;
+        owned.clear();
+    }
+}
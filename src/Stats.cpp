@@ -0,0 +1,102 @@
+#include "Stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include "Machine.hpp"
+
+namespace Stats{
+    Summary summarize(const Machine& m, const std::string& file, const std::string& error){
+        const Counters& c = m.stats;
+        Summary s = {
+            .file = file,
+            .error = error,
+            .data = c.data,
+            .text = c.text,
+            .decode = c.decode,
+            .run = c.run,
+            .emit = c.emit,
+            .executed = m.executed,
+            .mnemonics = {},
+            .bytesEmitted = m.out.bytes(),
+            .stackDepth = c.stackDepth,
+            .memoryPeak = m.memoryPeak
+        };
+
+        std::map<std::string, uint64_t> byName;
+        for(size_t i = 0; i < c.hits.size() && i < m.program.size(); i++){
+            if(!c.hits[i]) continue;
+            const Instr::Text& text = *m.program[i].text;
+            std::string name(text.mnemonic);
+            if(m.program[i].type == Instr::Type::LABEL) name = "(label)";
+            else if(name.empty()) std::istringstream(std::string(text.line)) >> name; // lines copied verbatim
+            byName[name] += c.hits[i];
+        }
+        s.mnemonics.assign(byName.begin(), byName.end());
+        std::stable_sort(s.mnemonics.begin(), s.mnemonics.end(),
+                         [](const auto& a, const auto& b){ return a.second > b.second; });
+        return s;
+    }
+
+    void printHuman(const Summary& s, std::ostream& out){
+        std::ostringstream o;
+        o << std::fixed << std::setprecision(3);
+        o << "  time (ms): data " << s.data * 1e3 << ", text " << s.text * 1e3
+          << ", decode " << s.decode * 1e3 << ", run " << s.run * 1e3 << ", emit " << s.emit * 1e3 << '\n';
+        o << "  executed: " << s.executed << " instructions, emitted: " << s.bytesEmitted << " bytes\n";
+        o << "  stack depth: " << s.stackDepth << " bytes, memoryPeak: " << s.memoryPeak << " bytes\n";
+        if(!s.mnemonics.empty()){
+            o << "  mnemonics:";
+            for(const auto& [name, count] : s.mnemonics) o << ' ' << name << '=' << count;
+            o << '\n';
+        }
+        if(!s.error.empty()) o << "  stopped: " << s.error << '\n';
+        out << o.str();
+    }
+
+    static void jsonString(std::ostream& out, const std::string& str){
+        out << '"';
+        for(char c : str){
+            switch(c){
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if(static_cast<unsigned char>(c) < 0x20)
+                        out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                    else
+                        out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void printJson(const std::vector<Summary>& summaries, std::ostream& out){
+        out << "[\n";
+        for(size_t i = 0; i < summaries.size(); i++){
+            const Summary& s = summaries[i];
+            out << "  {\"file\": ";
+            jsonString(out, s.file);
+            out << ", \"error\": ";
+            if(s.error.empty()) out << "null";
+            else jsonString(out, s.error);
+            out << ", \"seconds\": {\"data\": " << s.data << ", \"text\": " << s.text
+                << ", \"decode\": " << s.decode << ", \"run\": " << s.run << ", \"emit\": " << s.emit << '}'
+                << ", \"executed\": " << s.executed
+                << ", \"bytesEmitted\": " << s.bytesEmitted
+                << ", \"stackDepth\": " << s.stackDepth
+                << ", \"memoryPeak\": " << s.memoryPeak
+                << ", \"mnemonics\": {";
+            for(size_t j = 0; j < s.mnemonics.size(); j++){
+                if(j) out << ", ";
+                jsonString(out, s.mnemonics[j].first);
+                out << ": " << s.mnemonics[j].second;
+            }
+            out << "}}" << (i + 1 < summaries.size() ? ",\n" : "\n");
+        }
+        out << "]\n";
+    }
+}